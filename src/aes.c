@@ -0,0 +1,371 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aes.h"
+
+// Use AES-NI when the compiler can build it, it is picked at runtime if the cpu has it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AESNI 1
+#include <wmmintrin.h>
+#endif
+
+static const unsigned char sbox[256] =
+{
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const unsigned char invSbox[256] =
+{
+  0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+  0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+  0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+  0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+  0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+  0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+  0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+  0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+  0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+  0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+  0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+  0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+  0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+  0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+  0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+  0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
+};
+
+static const unsigned char rcon[10] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+
+/**
+ * Multiply by x in GF(2^8)
+ */
+static unsigned char xtime(unsigned char a)
+{
+    return (unsigned char)((a << 1) ^ ((a & 0x80) ? 0x1b : 0x00));
+}
+
+/**
+ * Multiply two numbers in GF(2^8)
+ */
+static unsigned char gmul(unsigned char a, unsigned char b)
+{
+    unsigned char p = 0;
+    while (b) {
+        if (b & 1) p ^= a;
+        a = xtime(a);
+        b >>= 1;
+    }
+    return p;
+}
+
+/**
+ * Encrypt a single 16 byte block in software
+ */
+static void encryptBlock(const unsigned char *roundKeys, const unsigned char in[16], unsigned char out[16])
+{
+    unsigned char s[16], t[16];
+    for (int i = 0; i < 16; i++) s[i] = in[i] ^ roundKeys[i];
+
+    for (int round = 1; round <= 10; round++) {
+        // sub bytes and shift rows
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                t[c * 4 + r] = sbox[s[((c + r) % 4) * 4 + r]];
+            }
+        }
+        // mix columns, except on the last round
+        if (round < 10) {
+            for (int c = 0; c < 4; c++) {
+                unsigned char *col = t + c * 4;
+                unsigned char a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+                unsigned char all = a0 ^ a1 ^ a2 ^ a3;
+                col[0] ^= all ^ xtime(a0 ^ a1);
+                col[1] ^= all ^ xtime(a1 ^ a2);
+                col[2] ^= all ^ xtime(a2 ^ a3);
+                col[3] ^= all ^ xtime(a3 ^ a0);
+            }
+        }
+        for (int i = 0; i < 16; i++) s[i] = t[i] ^ roundKeys[round * 16 + i];
+    }
+    memcpy(out, s, 16);
+}
+
+/**
+ * Decrypt a single 16 byte block in software
+ */
+static void decryptBlock(const unsigned char *roundKeys, const unsigned char in[16], unsigned char out[16])
+{
+    unsigned char s[16], t[16];
+    for (int i = 0; i < 16; i++) s[i] = in[i] ^ roundKeys[160 + i];
+
+    for (int round = 9; round >= 0; round--) {
+        // inverse shift rows and inverse sub bytes
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                t[((c + r) % 4) * 4 + r] = invSbox[s[c * 4 + r]];
+            }
+        }
+        for (int i = 0; i < 16; i++) t[i] ^= roundKeys[round * 16 + i];
+        // inverse mix columns, except after the last round
+        if (round > 0) {
+            for (int c = 0; c < 4; c++) {
+                unsigned char *col = t + c * 4;
+                unsigned char a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+                col[0] = gmul(a0, 14) ^ gmul(a1, 11) ^ gmul(a2, 13) ^ gmul(a3, 9);
+                col[1] = gmul(a0, 9) ^ gmul(a1, 14) ^ gmul(a2, 11) ^ gmul(a3, 13);
+                col[2] = gmul(a0, 13) ^ gmul(a1, 9) ^ gmul(a2, 14) ^ gmul(a3, 11);
+                col[3] = gmul(a0, 11) ^ gmul(a1, 13) ^ gmul(a2, 9) ^ gmul(a3, 14);
+            }
+        }
+        memcpy(s, t, 16);
+    }
+    memcpy(out, s, 16);
+}
+
+#ifdef HAVE_AESNI
+
+static bool aesNiSupported = false;
+
+/**
+ * Check for the AES instructions before main so there is nothing to race
+ * on later, setting OSNIS_NO_SIMD in the environment forces the software
+ * path so it can be tested
+ */
+__attribute__((constructor))
+static void detectAesNi(void)
+{
+    __builtin_cpu_init();
+    aesNiSupported = __builtin_cpu_supports("aes") && getenv("OSNIS_NO_SIMD") == NULL;
+}
+
+/**
+ * Turn the encryption round keys into the round keys aesdec wants
+ */
+__attribute__((target("aes,sse2")))
+static void aesNiDecryptKeys(struct AesKey *key)
+{
+    _mm_storeu_si128((__m128i *) key->decryptKeys, _mm_loadu_si128((const __m128i *) (key->encryptKeys + 160)));
+    for (int i = 1; i < 10; i++) {
+        __m128i k = _mm_loadu_si128((const __m128i *) (key->encryptKeys + (10 - i) * 16));
+        _mm_storeu_si128((__m128i *) (key->decryptKeys + i * 16), _mm_aesimc_si128(k));
+    }
+    _mm_storeu_si128((__m128i *) (key->decryptKeys + 160), _mm_loadu_si128((const __m128i *) key->encryptKeys));
+}
+
+/**
+ * CBC decrypt with AES-NI, the blocks do not depend on each other
+ * so four of them are kept in flight at once
+ */
+__attribute__((target("aes,sse2")))
+static void aesNiCbcDecrypt(const struct AesKey *key, const unsigned char iv[16], const unsigned char *in, unsigned char *out, size_t length)
+{
+    __m128i k[11];
+    for (int i = 0; i < 11; i++) k[i] = _mm_loadu_si128((const __m128i *) (key->decryptKeys + i * 16));
+
+    __m128i prev = _mm_loadu_si128((const __m128i *) iv);
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m128i c0 = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i c1 = _mm_loadu_si128((const __m128i *) (in + i + 16));
+        __m128i c2 = _mm_loadu_si128((const __m128i *) (in + i + 32));
+        __m128i c3 = _mm_loadu_si128((const __m128i *) (in + i + 48));
+        __m128i b0 = _mm_xor_si128(c0, k[0]);
+        __m128i b1 = _mm_xor_si128(c1, k[0]);
+        __m128i b2 = _mm_xor_si128(c2, k[0]);
+        __m128i b3 = _mm_xor_si128(c3, k[0]);
+        for (int r = 1; r < 10; r++) {
+            b0 = _mm_aesdec_si128(b0, k[r]);
+            b1 = _mm_aesdec_si128(b1, k[r]);
+            b2 = _mm_aesdec_si128(b2, k[r]);
+            b3 = _mm_aesdec_si128(b3, k[r]);
+        }
+        b0 = _mm_xor_si128(_mm_aesdeclast_si128(b0, k[10]), prev);
+        b1 = _mm_xor_si128(_mm_aesdeclast_si128(b1, k[10]), c0);
+        b2 = _mm_xor_si128(_mm_aesdeclast_si128(b2, k[10]), c1);
+        b3 = _mm_xor_si128(_mm_aesdeclast_si128(b3, k[10]), c2);
+        _mm_storeu_si128((__m128i *) (out + i), b0);
+        _mm_storeu_si128((__m128i *) (out + i + 16), b1);
+        _mm_storeu_si128((__m128i *) (out + i + 32), b2);
+        _mm_storeu_si128((__m128i *) (out + i + 48), b3);
+        prev = c3;
+    }
+    for (; i < length; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i b = _mm_xor_si128(c, k[0]);
+        for (int r = 1; r < 10; r++) b = _mm_aesdec_si128(b, k[r]);
+        b = _mm_xor_si128(_mm_aesdeclast_si128(b, k[10]), prev);
+        _mm_storeu_si128((__m128i *) (out + i), b);
+        prev = c;
+    }
+}
+
+/**
+ * CBC encrypt with AES-NI
+ */
+__attribute__((target("aes,sse2")))
+static void aesNiCbcEncrypt(const struct AesKey *key, const unsigned char iv[16], const unsigned char *in, unsigned char *out, size_t length)
+{
+    __m128i k[11];
+    for (int i = 0; i < 11; i++) k[i] = _mm_loadu_si128((const __m128i *) (key->encryptKeys + i * 16));
+
+    __m128i prev = _mm_loadu_si128((const __m128i *) iv);
+    for (size_t i = 0; i < length; i += 16) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + i)), prev);
+        b = _mm_xor_si128(b, k[0]);
+        for (int r = 1; r < 10; r++) b = _mm_aesenc_si128(b, k[r]);
+        prev = _mm_aesenclast_si128(b, k[10]);
+        _mm_storeu_si128((__m128i *) (out + i), prev);
+    }
+}
+
+/**
+ * CBC encrypt separate buffers in place with AES-NI, each buffer has to wait
+ * on its own last block but four buffers keep the aes unit busy
+ */
+__attribute__((target("aes,sse2")))
+static void aesNiCbcEncryptLanes(const struct AesKey *key, const unsigned char *const ivs[], unsigned char *const buffers[],
+        size_t count, size_t length)
+{
+    __m128i k[11];
+    for (int i = 0; i < 11; i++) k[i] = _mm_loadu_si128((const __m128i *) (key->encryptKeys + i * 16));
+
+    size_t lane = 0;
+    for (; lane + 4 <= count; lane += 4) {
+        unsigned char *out0 = buffers[lane], *out1 = buffers[lane + 1], *out2 = buffers[lane + 2], *out3 = buffers[lane + 3];
+        __m128i p0 = _mm_loadu_si128((const __m128i *) ivs[lane]);
+        __m128i p1 = _mm_loadu_si128((const __m128i *) ivs[lane + 1]);
+        __m128i p2 = _mm_loadu_si128((const __m128i *) ivs[lane + 2]);
+        __m128i p3 = _mm_loadu_si128((const __m128i *) ivs[lane + 3]);
+        for (size_t i = 0; i < length; i += 16) {
+            __m128i b0 = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *) (out0 + i)), p0), k[0]);
+            __m128i b1 = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *) (out1 + i)), p1), k[0]);
+            __m128i b2 = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *) (out2 + i)), p2), k[0]);
+            __m128i b3 = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *) (out3 + i)), p3), k[0]);
+            for (int r = 1; r < 10; r++) {
+                b0 = _mm_aesenc_si128(b0, k[r]);
+                b1 = _mm_aesenc_si128(b1, k[r]);
+                b2 = _mm_aesenc_si128(b2, k[r]);
+                b3 = _mm_aesenc_si128(b3, k[r]);
+            }
+            p0 = _mm_aesenclast_si128(b0, k[10]);
+            p1 = _mm_aesenclast_si128(b1, k[10]);
+            p2 = _mm_aesenclast_si128(b2, k[10]);
+            p3 = _mm_aesenclast_si128(b3, k[10]);
+            _mm_storeu_si128((__m128i *) (out0 + i), p0);
+            _mm_storeu_si128((__m128i *) (out1 + i), p1);
+            _mm_storeu_si128((__m128i *) (out2 + i), p2);
+            _mm_storeu_si128((__m128i *) (out3 + i), p3);
+        }
+    }
+    for (; lane < count; lane++) {
+        aesNiCbcEncrypt(key, ivs[lane], buffers[lane], buffers[lane], length);
+    }
+}
+
+#endif
+
+/**
+ * Expand a 16 byte key
+ */
+void aesSetKey(struct AesKey *key, const unsigned char userKey[16])
+{
+    unsigned char *w = key->encryptKeys;
+    memcpy(w, userKey, 16);
+    for (int i = 4; i < 44; i++) {
+        unsigned char t[4];
+        memcpy(t, w + (i - 1) * 4, 4);
+        if (i % 4 == 0) {
+            unsigned char first = t[0];
+            t[0] = sbox[t[1]] ^ rcon[i / 4 - 1];
+            t[1] = sbox[t[2]];
+            t[2] = sbox[t[3]];
+            t[3] = sbox[first];
+        }
+        for (int j = 0; j < 4; j++) w[i * 4 + j] = w[(i - 4) * 4 + j] ^ t[j];
+    }
+
+    // the software path uses the encryption round keys backwards
+    memcpy(key->decryptKeys, key->encryptKeys, 176);
+#ifdef HAVE_AESNI
+    if (aesNiSupported) {
+        aesNiDecryptKeys(key);
+    }
+#endif
+}
+
+/**
+ * AES-128-CBC decrypt length bytes, length has to be a multiple of 16
+ */
+void aesCbcDecrypt(const struct AesKey *key, const unsigned char iv[16], const unsigned char *in, unsigned char *out, size_t length)
+{
+#ifdef HAVE_AESNI
+    if (aesNiSupported) {
+        aesNiCbcDecrypt(key, iv, in, out, length);
+        return;
+    }
+#endif
+    unsigned char prev[16], cipher[16];
+    memcpy(prev, iv, 16);
+    for (size_t i = 0; i < length; i += 16) {
+        // in and out can be the same buffer so hold on to the cipher text
+        memcpy(cipher, in + i, 16);
+        decryptBlock(key->decryptKeys, cipher, out + i);
+        for (int j = 0; j < 16; j++) out[i + j] ^= prev[j];
+        memcpy(prev, cipher, 16);
+    }
+}
+
+/**
+ * AES-128-CBC encrypt length bytes, length has to be a multiple of 16
+ */
+void aesCbcEncrypt(const struct AesKey *key, const unsigned char iv[16], const unsigned char *in, unsigned char *out, size_t length)
+{
+#ifdef HAVE_AESNI
+    if (aesNiSupported) {
+        aesNiCbcEncrypt(key, iv, in, out, length);
+        return;
+    }
+#endif
+    unsigned char block[16];
+    const unsigned char *prev = iv;
+    for (size_t i = 0; i < length; i += 16) {
+        for (int j = 0; j < 16; j++) block[j] = in[i + j] ^ prev[j];
+        encryptBlock(key->encryptKeys, block, out + i);
+        prev = out + i;
+    }
+}
+
+/**
+ * AES-128-CBC encrypt count separate buffers of length bytes in place, each
+ * with its own iv.  The buffers do not depend on each other so with AES-NI
+ * four of them are encrypted at once
+ */
+void aesCbcEncryptLanes(const struct AesKey *key, const unsigned char *const ivs[], unsigned char *const buffers[],
+        size_t count, size_t length)
+{
+#ifdef HAVE_AESNI
+    if (aesNiSupported) {
+        aesNiCbcEncryptLanes(key, ivs, buffers, count, length);
+        return;
+    }
+#endif
+    for (size_t lane = 0; lane < count; lane++) {
+        aesCbcEncrypt(key, ivs[lane], buffers[lane], buffers[lane], length);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef AES_H
+#define AES_H
+
+#include <stddef.h>
+
+/**
+ * An expanded AES-128 key, with the round keys for both directions
+ */
+struct AesKey
+{
+    unsigned char encryptKeys[176];
+    unsigned char decryptKeys[176];
+};
+
+/**
+ * Expand a 16 byte key
+ */
+void aesSetKey(struct AesKey *key, const unsigned char userKey[16]);
+
+/**
+ * AES-128-CBC decrypt length bytes, length has to be a multiple of 16
+ */
+void aesCbcDecrypt(const struct AesKey *key, const unsigned char iv[16], const unsigned char *in, unsigned char *out, size_t length);
+
+/**
+ * AES-128-CBC encrypt length bytes, length has to be a multiple of 16
+ */
+void aesCbcEncrypt(const struct AesKey *key, const unsigned char iv[16], const unsigned char *in, unsigned char *out, size_t length);
+
+/**
+ * AES-128-CBC encrypt count separate buffers of length bytes in place, each
+ * with its own iv.  The buffers do not depend on each other so with AES-NI
+ * four of them are encrypted at once
+ */
+void aesCbcEncryptLanes(const struct AesKey *key, const unsigned char *const ivs[], unsigned char *const buffers[],
+        size_t count, size_t length);
+
+#endif
@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "disc_info.h"
+#include "checkpoint.h"
+
+/**
+ * Get the name of the checkpoint file that belongs to an output file
+ */
+char * getCheckpointFile(char *outputFile)
+{
+    size_t length = strlen(outputFile);
+    char *file = calloc(1, length + 6);
+    memcpy(file, outputFile, length);
+    memcpy(file + length, ".ckpt", 5);
+    return file;
+}
+
+/**
+ * Write the checkpoint and partition table to the checkpoint file
+ *
+ * The checkpoint is written to a temporary file first, synced and
+ * renamed so an interruption never leaves a half written checkpoint behind
+ */
+bool writeCheckpoint(char *file, struct Checkpoint *checkpoint, unsigned char *table)
+{
+    size_t length = strlen(file);
+    char *tempFile = calloc(1, length + 5);
+    memcpy(tempFile, file, length);
+    memcpy(tempFile + length, ".tmp", 4);
+
+    FILE *f = fopen(tempFile, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "CHECKPOINT ERROR: could not open %s\n", tempFile);
+        free(tempFile);
+        return false;
+    }
+
+    bool written = fwrite(CHECKPOINT_MAGIC_WORD, 8, 1, f) == 1
+        && fwrite(&checkpoint->blockNum, 8, 1, f) == 1
+        && fwrite(&checkpoint->outputOffset, 8, 1, f) == 1
+        && fwrite(&checkpoint->dataBlockNum, 4, 1, f) == 1
+        && fwrite(&checkpoint->prevCrc, 4, 1, f) == 1
+        && fwrite(&checkpoint->inputCrc, 4, 1, f) == 1
+        && fwrite(&checkpoint->outputCrc, 4, 1, f) == 1
+        && fwrite(&checkpoint->tableSize, 8, 1, f) == 1
+        && fwrite(table, checkpoint->tableSize, 1, f) == 1
+        && fflush(f) == 0
+        && fsync(fileno(f)) == 0;
+    written = (fclose(f) == 0) && written;
+
+    if (!written || rename(tempFile, file) != 0) {
+        fprintf(stderr, "CHECKPOINT ERROR: could not write %s\n", file);
+        remove(tempFile);
+        free(tempFile);
+        return false;
+    }
+    free(tempFile);
+    return true;
+}
+
+/**
+ * Read the checkpoint and partition table from the checkpoint file
+ */
+bool readCheckpoint(char *file, struct Checkpoint *checkpoint, unsigned char **table)
+{
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "CHECKPOINT ERROR: could not open %s\n", file);
+        return false;
+    }
+
+    unsigned char magic[8];
+    bool read = fread(magic, 8, 1, f) == 1
+        && memcmp(magic, CHECKPOINT_MAGIC_WORD, 8) == 0
+        && fread(&checkpoint->blockNum, 8, 1, f) == 1
+        && fread(&checkpoint->outputOffset, 8, 1, f) == 1
+        && fread(&checkpoint->dataBlockNum, 4, 1, f) == 1
+        && fread(&checkpoint->prevCrc, 4, 1, f) == 1
+        && fread(&checkpoint->inputCrc, 4, 1, f) == 1
+        && fread(&checkpoint->outputCrc, 4, 1, f) == 1
+        && fread(&checkpoint->tableSize, 8, 1, f) == 1
+        && checkpoint->tableSize >= MIN_BLOCK_SIZE
+        && checkpoint->tableSize <= MAX_TABLE_SIZE;
+
+    *table = NULL;
+    if (read) {
+        *table = calloc(1, checkpoint->tableSize);
+        read = fread(*table, checkpoint->tableSize, 1, f) == 1;
+    }
+    fclose(f);
+
+    if (!read) {
+        fprintf(stderr, "CHECKPOINT ERROR: %s is not a valid checkpoint\n", file);
+        free(*table);
+        *table = NULL;
+    }
+    return read;
+}
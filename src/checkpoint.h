@@ -0,0 +1,44 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+static const unsigned char CHECKPOINT_MAGIC_WORD[8] = {'O','S','N','I','S','C','K','P'};
+
+// Write a checkpoint every 1024 blocks, 32MB to 1GB of input depending on
+// the block size and 256MB at the default
+static const size_t CHECKPOINT_INTERVAL = 1024;
+
+/**
+ * Everything needed to pick up a shrink where it left off
+ */
+struct Checkpoint
+{
+    uint64_t blockNum;
+    uint64_t outputOffset;
+    uint64_t tableSize;
+    uint32_t dataBlockNum;
+    uint32_t prevCrc;
+    uint32_t inputCrc;
+    // crc of the output after the partition table, up to outputOffset
+    uint32_t outputCrc;
+};
+
+/**
+ * Get the name of the checkpoint file that belongs to an output file
+ */
+char * getCheckpointFile(char *outputFile);
+
+/**
+ * Write the checkpoint and partition table to the checkpoint file
+ */
+bool writeCheckpoint(char *file, struct Checkpoint *checkpoint, unsigned char *table);
+
+/**
+ * Read the checkpoint and partition table from the checkpoint file,
+ * the table is allocated to the size stored in the checkpoint
+ */
+bool readCheckpoint(char *file, struct Checkpoint *checkpoint, unsigned char **table);
+
+#endif
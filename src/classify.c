@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "crc32.h"
+#include "classify.h"
+
+// x86 cpus with AVX2 can check a chunk against the junk and the repeated
+// byte 32 bytes at a time in one pass
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+// Small enough that the block chunk and its junk stay in the L1 cache
+// while all three checks run over them
+#define CLASSIFY_CHUNK_SIZE 0x2000
+
+/**
+ * Check that every byte in the chunk is the same as the pattern,
+ * 8 bytes at a time
+ */
+static bool isUniformChunk(const unsigned char *chunk, size_t length, uint64_t pattern)
+{
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, chunk + i, 8);
+        if (word != pattern) {
+            return false;
+        }
+    }
+    for (; i < length; i++) {
+        if (chunk[i] != (unsigned char) pattern) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef HAVE_AVX2
+
+static bool hasAvx2 = false;
+
+/**
+ * Check for AVX2 before main so there is nothing to race on later,
+ * setting OSNIS_NO_SIMD in the environment forces the portable check
+ */
+__attribute__((constructor))
+static void detectAvx2(void)
+{
+    __builtin_cpu_init();
+    hasAvx2 = __builtin_cpu_supports("avx2") && getenv("OSNIS_NO_SIMD") == NULL;
+}
+
+/**
+ * Compare 128 bytes at a time to the junk and the repeated byte, reading
+ * the chunk once for both, and leave the tail to the portable check
+ *
+ * Returns how many bytes were checked
+ */
+__attribute__((target("avx2")))
+static size_t checkChunkAvx2(const unsigned char *chunk, const unsigned char *junk, size_t length,
+        unsigned char byte, bool *isJunk, bool *isUniform)
+{
+    const __m256i pattern = _mm256_set1_epi8((char) byte);
+    size_t i = 0;
+    for (; i + 128 <= length && (*isJunk || *isUniform); i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (chunk + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (chunk + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *) (chunk + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *) (chunk + i + 96));
+        if (*isJunk) {
+            __m256i same = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, _mm256_loadu_si256((const __m256i *) (junk + i))),
+                    _mm256_cmpeq_epi8(b, _mm256_loadu_si256((const __m256i *) (junk + i + 32)))),
+                _mm256_and_si256(_mm256_cmpeq_epi8(c, _mm256_loadu_si256((const __m256i *) (junk + i + 64))),
+                    _mm256_cmpeq_epi8(d, _mm256_loadu_si256((const __m256i *) (junk + i + 96)))));
+            *isJunk = _mm256_movemask_epi8(same) == -1;
+        }
+        if (*isUniform) {
+            __m256i same = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, pattern), _mm256_cmpeq_epi8(b, pattern)),
+                _mm256_and_si256(_mm256_cmpeq_epi8(c, pattern), _mm256_cmpeq_epi8(d, pattern)));
+            *isUniform = _mm256_movemask_epi8(same) == -1;
+        }
+    }
+    return i;
+}
+
+#endif
+
+/**
+ * Check a chunk against its junk and the repeated byte, clearing isJunk
+ * or isUniform when it is not
+ */
+static void checkChunk(const unsigned char *chunk, const unsigned char *junk, size_t length,
+        uint64_t pattern, bool *isJunk, bool *isUniform)
+{
+#ifdef HAVE_AVX2
+    if (hasAvx2) {
+        size_t done = checkChunkAvx2(chunk, junk, length, (unsigned char) pattern, isJunk, isUniform);
+        chunk += done;
+        junk += done;
+        length -= done;
+    }
+#endif
+    if (*isJunk) {
+        *isJunk = memcmp(chunk, junk, length) == 0;
+    }
+    if (*isUniform) {
+        *isUniform = isUniformChunk(chunk, length, pattern);
+    }
+}
+
+/**
+ * Work out if a block is junk, a uniform repeated byte or data and
+ * get its crc, all in a single pass over the block
+ *
+ * The block is taken a chunk at a time and each chunk is compared to the
+ * junk, checked for the repeated byte and added to the crc while it is
+ * still in the cache.  Junk is only generated until the first chunk that
+ * does not match, so data blocks only cost the junk for one chunk.
+ */
+struct BlockClass classifyBlock(const unsigned char *block, size_t length, uint64_t offset,
+        unsigned char id[], unsigned char discNumber)
+{
+    struct BlockClass result = {0, BLOCK_DATA, 0};
+    if (length == 0) {
+        return result;
+    }
+
+    unsigned char junk[CLASSIFY_CHUNK_SIZE];
+    struct JunkStream stream;
+    initJunkStream(&stream, id, discNumber, offset);
+
+    bool isJunk = true;
+    bool isUniform = true;
+    uint64_t pattern = 0x0101010101010101ULL * block[0];
+
+    for (size_t done = 0; done < length; done += CLASSIFY_CHUNK_SIZE) {
+        const unsigned char *chunk = block + done;
+        size_t count = (length - done < CLASSIFY_CHUNK_SIZE) ? length - done : CLASSIFY_CHUNK_SIZE;
+
+        if (isJunk) {
+            readJunkStream(&stream, junk, count);
+        }
+        checkChunk(chunk, junk, count, pattern, &isJunk, &isUniform);
+        result.crc = crc32(chunk, count, result.crc);
+    }
+
+    // junk wins over uniform the same way it always has
+    if (isJunk) {
+        result.kind = BLOCK_JUNK;
+    } else if (isUniform) {
+        result.kind = BLOCK_UNIFORM;
+        result.repeatByte = block[0];
+    }
+    return result;
+}
@@ -0,0 +1,30 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+static const unsigned char BLOCK_DATA = 0x00;
+static const unsigned char BLOCK_JUNK = 0x01;
+static const unsigned char BLOCK_UNIFORM = 0x02;
+
+/**
+ * What a block turned out to be, the crc is always of the whole block
+ */
+struct BlockClass
+{
+    uint32_t crc;
+    unsigned char kind;
+    unsigned char repeatByte;
+};
+
+/**
+ * Work out if a block is junk, a uniform repeated byte or data and
+ * get its crc, all in a single pass over the block
+ *
+ * The junk is generated from the given offset and disc id
+ */
+struct BlockClass classifyBlock(const unsigned char *block, size_t length, uint64_t offset,
+        unsigned char id[], unsigned char discNumber);
+
+#endif
@@ -5,101 +5,105 @@
 #include "hash.h"
 #include "disc_info.h"
 #include "crc32.h"
+#include "wii.h"
+#include "osnis.h"
 
 /*
  * Profile a disk.  Expects a full iso with valid 
  * disc id and magic number
  */
-struct DiscInfo * profileImage(char *file)
+struct DiscInfo * profileImage(char *file, size_t blockSize, unsigned char *commonKey)
 {
     // if file pointer is empty read from stdin
     FILE *f = (file != NULL) ? fopen(file, "rb") : stdin;
 
     struct DiscInfo *discInfo = calloc(sizeof(struct DiscInfo), 1);
-    
-    // Do all of our reading in 0x40000 byte blocks
-    unsigned char * buffer = calloc(1, BLOCK_SIZE);
-    unsigned char * repeatByte;
-    uint32_t prevCrc = 0;
-    uint32_t dataBlockNum = 0;
-    size_t blockNum = 0;
-    size_t read;
-    while((read = fread(buffer, 1, BLOCK_SIZE, f)) > 0) {
-
-        // get the disc info from the first block
-        if (blockNum == 0) {
-            getDiscInfo(discInfo, buffer);
-        }
-
-        // if the first block has the shrunken magic word this 
-        // is a shrunken image and the first block is the partition
-        // table and the disc info will be in the second block
-        else if (blockNum == 1 && discInfo->isShrunken) {
-            getDiscInfo(discInfo, buffer);
-            return discInfo;
-        }
+    discInfo->blockSize = (blockSize != 0) ? blockSize : BLOCK_SIZE;
 
-        // get the junk block for this block number
-        // for the purposes of getting junk the blockNum starts at 0
-        unsigned char * junk = getJunkBlock(blockNum, discInfo->discId, discInfo->discNumber);
+    // Do all of our reading in blocks of the chosen block size
+    unsigned char * buffer = calloc(1, discInfo->blockSize);
 
-        // check if this is a junk block
-        if (isSame(buffer, junk, read)) {
-            // Write ffs to the partition table for the address
-            memcpy(discInfo->table + ((blockNum + 1) * 8), &FFs, 4);
+    // the first MIN_BLOCK_SIZE bytes are enough to tell what kind of image this is
+    if (fread(buffer, 1, MIN_BLOCK_SIZE, f) != MIN_BLOCK_SIZE) {
+        fprintf(stderr, "ERROR: could not read the first block\n");
+        return discInfo;
+    }
+    getDiscInfo(discInfo, buffer);
 
-            // get the crc of the junk block and copy it to the table
-            uint32_t crc = crc32(junk, read, 0);
-            memcpy(discInfo->table + ((blockNum + 1) * 8) + 4, &crc, 4);
+    // if the first block has the shrunken magic word this
+    // is a shrunken image and the first block is the partition
+    // table and the disc info will be in the block after it
+    if (discInfo->isShrunken) {
+        if (readTable(discInfo, f) && fread(buffer, 1, MIN_BLOCK_SIZE, f) == MIN_BLOCK_SIZE) {
+            getDiscInfo(discInfo, buffer);
         }
+        return discInfo;
+    }
+    if (discInfo->table == NULL) {
+        return discInfo;
+    }
 
-        // check if this is a block of repeated junk byte
-        else if((repeatByte = isUniform(buffer, read)) != NULL) {
-            // write our repeated byte to the partition table
-            memcpy(discInfo->table + ((blockNum + 1) * 8), &FEs, 4);
-            memcpy(discInfo->table + ((blockNum + 1)* 8) + 7, repeatByte, 1);
+    // find the partitions before reading on, this needs a file we can seek in
+    if (discInfo->isWII && commonKey != NULL) {
+        discInfo->commonKey = commonKey;
+        if (file == NULL) {
+            fprintf(stderr, "Wii partitions can not be decrypted from stdin\n");
+        } else {
+            readWiiPartitions(discInfo, file);
         }
+    }
 
-        // If this is not a junk block then it is a data block
-        else {
-            // get the crc of the block
-            uint32_t crc = crc32(buffer, read, 0);
-
-            // only advance the block number if this was not a repeat block
-            if (prevCrc != crc) {
-                dataBlockNum++;
-            }
-            prevCrc = crc;
-
-            // copy the block number and crc to the table
-            memcpy(discInfo->table + ((blockNum + 1) * 8), &dataBlockNum, 4);
-            memcpy(discInfo->table + ((blockNum + 1) * 8) + 4, &crc, 4);
+    // profiling is encoding without writing anything, the table is
+    // built up in the disc info as the blocks go by
+    struct OsnisEncoder encoder;
+    osnisEncoderInit(&encoder, discInfo, false, 0, NULL, NULL, NULL);
+    size_t read = MIN_BLOCK_SIZE + fread(buffer + MIN_BLOCK_SIZE, 1, discInfo->blockSize - MIN_BLOCK_SIZE, f);
+    do {
+        if (!osnisEncoderPush(&encoder, buffer, read)) {
+            break;
         }
-        blockNum++;
+    } while((read = fread(buffer, 1, discInfo->blockSize, f)) > 0);
+    if (!osnisEncoderFinish(&encoder)) {
+        fprintf(stderr, "SHRINK ERROR: %s\n", encoder.error);
     }
+    osnisEncoderFree(&encoder);
     fclose(f);
+    free(buffer);
 
-    if (blockNum == WII_DL_BLOCK_NUM) {
-        discInfo->isDualLayer = true;
-    }
+    return discInfo;
+}
 
-    // set the disc type
-    if (discInfo->isWII && discInfo->isDualLayer) {
-        memset(discInfo->table + 7, WII_DL_DISC, 1);
-    } else if(discInfo->isWII) {
-        memset(discInfo->table + 7, WII_DISC, 1);
-    } else if(discInfo->isGC) {
-        memset(discInfo->table + 7, GC_DISC, 1);
+/**
+ * Free a disc info and everything it points to except the common key
+ */
+void freeDiscInfo(struct DiscInfo *discInfo)
+{
+    if (discInfo == NULL) {
+        return;
     }
+    free(discInfo->table);
+    free(discInfo->discId);
+    free(discInfo->discName);
+    free(discInfo->partitions);
+    free(discInfo);
+}
 
-    return discInfo;
+/**
+ * Get the size of a partition table for a disc size and block size
+ */
+static size_t tableSizeFor(uint64_t discSize, size_t blockSize)
+{
+    size_t blockCount = (discSize + blockSize - 1) / blockSize;
+    size_t entries = (blockCount + 1) * 8;
+    return ((entries + blockSize - 1) / blockSize) * blockSize;
 }
 
 /**
  * Get the disc info from the first block of data
  *
- * If this is a shrunken image call this function twice
- * with the first and second block
+ * If this is a shrunken image call readTable to get the rest
+ * of the partition table and then call this function again
+ * with the first data block
  */
 void getDiscInfo(struct DiscInfo *discInfo, unsigned char data[])
 {
@@ -110,12 +114,22 @@ void getDiscInfo(struct DiscInfo *discInfo, unsigned char data[])
     // is the partition table and the second block has all the
     // disc info
     if (isShrunken) {
-
-        // create a partition table using the data
-        discInfo->table = calloc(1, BLOCK_SIZE);
-        memcpy(discInfo->table, data, BLOCK_SIZE);
         discInfo->isShrunken = true;
 
+        // the block size is stored as a power of two in the low bits of byte 5,
+        // 0 is the default, and the top bit says there is a manifest
+        unsigned char shift = data[5] & 0x1F;
+        discInfo->blockSize = (shift != 0) ? (size_t) 1 << shift : BLOCK_SIZE;
+        discInfo->hasManifest = (data[5] & MANIFEST_FLAG) != 0;
+
+        // newer versions can have entries we do not know how to read, and a
+        // version 0 image with anything in byte 5 did not come from us
+        if (data[6] > SHRUNKEN_VERSION || (data[6] == 0 && data[5] != 0)) {
+            fprintf(stderr, "ERROR: This is a version %d shrunken image, we only understand up to version %d\n",
+                data[6], SHRUNKEN_VERSION);
+            return;
+        }
+
         // for shrunken images the disc type is at byte 7
         switch(data[7]) {
             case 0x01: // GC_DISC
@@ -130,6 +144,18 @@ void getDiscInfo(struct DiscInfo *discInfo, unsigned char data[])
                 break;
         }
 
+        if (!isValidBlockSize(discInfo->blockSize) || (!discInfo->isGC && !discInfo->isWII)) {
+            fprintf(stderr, "ERROR: This is not a shrunken image we understand\n");
+            discInfo->isGC = false;
+            discInfo->isWII = false;
+            return;
+        }
+
+        // create a partition table using the data, the rest
+        // of it is filled in by readTable
+        discInfo->table = calloc(1, getTableSize(discInfo));
+        memcpy(discInfo->table, data, MIN_BLOCK_SIZE);
+
     } else {
     	// the disc id comes from bytes 0 through 5
         discInfo->discId = calloc(1, 7);
@@ -152,15 +178,203 @@ void getDiscInfo(struct DiscInfo *discInfo, unsigned char data[])
         }
 
         if (discInfo->table == NULL) {
-            // create a partition table
-            discInfo->table = calloc(1, BLOCK_SIZE);
+            if (discInfo->blockSize == 0) {
+                discInfo->blockSize = BLOCK_SIZE;
+            }
+
+            // create a partition table, until the whole disc has been
+            // read a wii disc could still turn out to be dual layer
+            uint64_t discSize = discInfo->isGC ? GC_DISC_SIZE : WII_DL_DISC_SIZE;
+            discInfo->table = calloc(1, tableSizeFor(discSize, discInfo->blockSize));
 
             // write the shrunken magic word to the partition table
             memcpy(discInfo->table, SHRUNKEN_MAGIC_WORD, 5);
+
+            // only write the block size if it is not the default
+            if (discInfo->blockSize != BLOCK_SIZE) {
+                unsigned char shift = 0;
+                while (((size_t) 1 << shift) < discInfo->blockSize) {
+                    shift++;
+                }
+                discInfo->table[5] = shift;
+            }
         }
     }
 }
 
+/**
+ * Read the rest of the partition table of a shrunken image
+ * after getDiscInfo has seen the first MIN_BLOCK_SIZE bytes
+ */
+bool readTable(struct DiscInfo *discInfo, FILE *f)
+{
+    size_t tableSize = getTableSize(discInfo);
+    if (fread(discInfo->table + MIN_BLOCK_SIZE, 1, tableSize - MIN_BLOCK_SIZE, f) != tableSize - MIN_BLOCK_SIZE) {
+        fprintf(stderr, "ERROR: could not read partition table\n");
+        return false;
+    }
+
+    // a manifest after the entries can make the table longer
+    size_t fullSize = readManifestCount(discInfo);
+    if (fullSize == 0 || fread(discInfo->table + tableSize, 1, fullSize - tableSize, f) != fullSize - tableSize) {
+        fprintf(stderr, "ERROR: could not read manifest\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Get the size in bytes of the full disc
+ */
+uint64_t getDiscSize(struct DiscInfo *discInfo)
+{
+    if (discInfo->isWII && discInfo->isDualLayer) {
+        return WII_DL_DISC_SIZE;
+    } else if(discInfo->isWII) {
+        return WII_DISC_SIZE;
+    } else if(discInfo->isGC) {
+        return GC_DISC_SIZE;
+    }
+    return 0;
+}
+
+/**
+ * Get the number of blocks the full disc is split into
+ */
+size_t getBlockCount(struct DiscInfo *discInfo)
+{
+    return (getDiscSize(discInfo) + discInfo->blockSize - 1) / discInfo->blockSize;
+}
+
+/**
+ * Get the size of the given block, only the last block can be short
+ */
+size_t getBlockLength(struct DiscInfo *discInfo, size_t blockNum)
+{
+    uint64_t offset = (uint64_t) blockNum * discInfo->blockSize;
+    uint64_t discSize = getDiscSize(discInfo);
+    if (offset >= discSize) {
+        return 0;
+    }
+    return (discSize - offset < discInfo->blockSize) ? discSize - offset : discInfo->blockSize;
+}
+
+/**
+ * Get the size of the partition table, always a whole number of blocks
+ */
+size_t getTableSize(struct DiscInfo *discInfo)
+{
+    if (!discInfo->hasManifest) {
+        return tableSizeFor(getDiscSize(discInfo), discInfo->blockSize);
+    }
+
+    // the manifest is a count and then 8 bytes for each range
+    size_t size = getManifestOffset(discInfo) + 4 + discInfo->manifestCount * 8;
+    return ((size + discInfo->blockSize - 1) / discInfo->blockSize) * discInfo->blockSize;
+}
+
+/**
+ * Set the version byte of a finished partition table to the
+ * lowest version that can read everything in it
+ */
+void setShrunkenVersion(struct DiscInfo *discInfo)
+{
+    bool extended = discInfo->table[5] != 0;
+    size_t entryCount = getBlockCount(discInfo) + 1;
+    for (size_t blockNum = 1; blockNum < entryCount && !extended; blockNum++) {
+        extended = isWiiPartitionMarker(discInfo->table[(blockNum * 8) + 3]);
+    }
+    discInfo->table[6] = extended ? SHRUNKEN_VERSION : 0x00;
+}
+
+/**
+ * Get where the manifest starts in the partition table, right after the last entry
+ */
+size_t getManifestOffset(struct DiscInfo *discInfo)
+{
+    return (getBlockCount(discInfo) + 1) * 8;
+}
+
+/**
+ * Once the partition table has been read up to getTableSize, pick up how
+ * many ranges the manifest has and make room for them in the table
+ */
+size_t readManifestCount(struct DiscInfo *discInfo)
+{
+    size_t tableSize = getTableSize(discInfo);
+    if (!discInfo->hasManifest) {
+        return tableSize;
+    }
+
+    // every block can only be in the manifest once so there
+    // can never be more ranges than blocks
+    uint32_t count;
+    memcpy(&count, discInfo->table + getManifestOffset(discInfo), 4);
+    if (count > getBlockCount(discInfo)) {
+        fprintf(stderr, "ERROR: manifest is not valid\n");
+        return 0;
+    }
+    discInfo->manifestCount = count;
+
+    size_t fullSize = getTableSize(discInfo);
+    if (fullSize > tableSize) {
+        discInfo->table = realloc(discInfo->table, fullSize);
+    }
+    return fullSize;
+}
+
+/**
+ * Get the first block and number of blocks of a range in the manifest
+ */
+bool getManifestRange(struct DiscInfo *discInfo, size_t index, size_t *firstBlock, size_t *blockCount)
+{
+    if (index >= discInfo->manifestCount) {
+        return false;
+    }
+    uint32_t range[2];
+    memcpy(range, discInfo->table + getManifestOffset(discInfo) + 4 + index * 8, 8);
+    if (range[0] >= getBlockCount(discInfo) || range[1] > getBlockCount(discInfo) - range[0]) {
+        return false;
+    }
+    *firstBlock = range[0];
+    *blockCount = range[1];
+    return true;
+}
+
+/**
+ * Replace the manifest with count ranges, each a first block and a number of
+ * blocks, in the order they were read.  A count of 0 removes the manifest
+ */
+void setManifest(struct DiscInfo *discInfo, const uint32_t *ranges, size_t count)
+{
+    discInfo->hasManifest = count > 0;
+    discInfo->manifestCount = count;
+
+    // anything after the entries that is not the manifest stays zero
+    size_t manifestOffset = getManifestOffset(discInfo);
+    size_t tableSize = getTableSize(discInfo);
+    discInfo->table = realloc(discInfo->table, tableSize);
+    memset(discInfo->table + manifestOffset, 0, tableSize - manifestOffset);
+
+    if (discInfo->hasManifest) {
+        uint32_t count32 = count;
+        memcpy(discInfo->table + manifestOffset, &count32, 4);
+        memcpy(discInfo->table + manifestOffset + 4, ranges, count * 8);
+        discInfo->table[5] |= MANIFEST_FLAG;
+    } else {
+        discInfo->table[5] &= ~MANIFEST_FLAG;
+    }
+    setShrunkenVersion(discInfo);
+}
+
+/**
+ * Check that a block size is a power of two between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE
+ */
+bool isValidBlockSize(size_t blockSize)
+{
+    return blockSize >= MIN_BLOCK_SIZE && blockSize <= MAX_BLOCK_SIZE && (blockSize & (blockSize - 1)) == 0;
+}
+
 /**
  * Print out the disc info
  */
@@ -179,6 +393,7 @@ void printDiscInfo(struct DiscInfo * discInfo) {
     fprintf(stderr, "Disc Id: %.*s\n", 6, discInfo->discId);
     fprintf(stderr, "Disc Name: %s\n", discInfo->discName);
     fprintf(stderr, "Disc Number: %d\n", discInfo->discNumber);
+    fprintf(stderr, "Block Size: 0x%zx\n", discInfo->blockSize);
 
     uint32_t prevCrc = 0;
 
@@ -186,9 +401,11 @@ void printDiscInfo(struct DiscInfo * discInfo) {
     int generatedJunkCount = 0;
     int repeatJunkCount = 0;
     int repeatBlock = 0;
+    int decryptedBlock = 0;
     
     int blockNum;
-    for(blockNum = 1; blockNum < BLOCK_SIZE; blockNum++) {
+    int entryCount = getBlockCount(discInfo) + 1;
+    for(blockNum = 1; blockNum < entryCount; blockNum++) {
         
         // if 8 00s we are at the end of the disc
         if (memcmp(&ZEROs, discInfo->table + (blockNum * 8), 8) == 0) {
@@ -232,11 +449,17 @@ void printDiscInfo(struct DiscInfo * discInfo) {
                 repeatJunkCount = 0;
             }
 
-            // see if we are a repeated data block
-            if (memcmp(&prevCrc, discInfo->table + (blockNum * 8) + 4, 4) == 0) {
-                repeatBlock++;
+            // decrypted partition blocks are never repeats
+            if (isWiiPartitionMarker(discInfo->table[(blockNum * 8) + 3])) {
+                decryptedBlock++;
+                prevCrc = 0;
+            } else {
+                // see if we are a repeated data block
+                if (memcmp(&prevCrc, discInfo->table + (blockNum * 8) + 4, 4) == 0) {
+                    repeatBlock++;
+                }
+                memcpy(&prevCrc, discInfo->table + (blockNum * 8) + 4, 4);
             }
-            memcpy(&prevCrc, discInfo->table + (blockNum * 8) + 4, 4);
 
             dataCount++;
         }
@@ -253,6 +476,13 @@ void printDiscInfo(struct DiscInfo * discInfo) {
     if (repeatBlock > 0) {
         fprintf(stderr, "%05d BLOCKS REPEATED\n", repeatBlock);
     }
+    if (decryptedBlock > 0) {
+        fprintf(stderr, "%05d BLOCKS DECRYPTED\n", decryptedBlock);
+    }
 
     fprintf(stderr, "%05d TOTAL BLOCKS\n", blockNum - 1);
+
+    if (discInfo->hasManifest) {
+        fprintf(stderr, "%05zu MANIFEST RANGES\n", discInfo->manifestCount);
+    }
 }
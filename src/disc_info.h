@@ -3,9 +3,14 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
-// Once a stable version is achieved the version number will change to 1
+// The version is at byte 6.  Version 0 images always use the default block size
+// and only have data, junk and repeat entries.  Anything a version 0 reader
+// would get wrong, another block size, decrypted wii partition blocks or a
+// manifest, makes the image version 1
 static const unsigned char SHRUNKEN_MAGIC_WORD[8] = {'O','S','N','I','S',0x00,0x00,0x00};
+static const unsigned char SHRUNKEN_VERSION = 0x01;
 
 static const uint64_t FFs = 0xFFFFFFFFFFFFFFFF;
 static const uint64_t FEs = 0xFEFEFEFEFEFEFEFE;
@@ -15,42 +20,128 @@ static const unsigned char GC_DISC = 0x01;
 static const unsigned char WII_DISC = 0x10;
 static const unsigned char WII_DL_DISC = 0x11;
 
-static const size_t GC_LAST_BLOCK_SIZE = 0x18000;
-static const size_t WII_LAST_BLOCK_SIZE = 0x40000;
-static const size_t WII_DL_LAST_BLOCK_SIZE = 0x20000;
+static const uint64_t GC_DISC_SIZE = 0x57058000;
+static const uint64_t WII_DISC_SIZE = 0x118240000;
+static const uint64_t WII_DL_DISC_SIZE = 0x1FB4E0000;
 
-static const size_t GC_BLOCK_NUM = 5570;
-static const size_t WII_BLOCK_NUM = 17929;
-static const size_t WII_DL_BLOCK_NUM = 32468;
+// Block sizes have to be a power of two that lines up with the 0x8000 byte junk segments
+static const size_t MIN_BLOCK_SIZE = 0x8000;
+static const size_t MAX_BLOCK_SIZE = 0x100000;
+
+// A dual layer wii image with the smallest block size needs the biggest table
+static const size_t MAX_TABLE_SIZE = 0x200000;
+
+// The top bit of the block size byte says a manifest follows the table entries
+static const unsigned char MANIFEST_FLAG = 0x80;
 
 static const unsigned char GC_MAGIC_WORD[] = {0xC2, 0x33, 0x9F, 0x3D};
 static const unsigned char WII_MAGIC_WORD[] = {0x5D, 0x1C, 0x9E, 0xA3};
 
+struct WiiPartition;
+
 struct DiscInfo
 {
     unsigned char * discId;
     unsigned char discNumber;
     unsigned char * discName;
     unsigned char * table;
+    size_t blockSize;
     bool isGC;
     bool isWII;
     bool isDualLayer;
     bool isShrunken;
+    bool hasManifest;
+    size_t manifestCount;
+    unsigned char * commonKey;
+    struct WiiPartition * partitions;
+    size_t partitionCount;
 };
 
 /**
- * Get disc info from image
+ * Get disc info from image using the given block size, 0 for the default
+ *
+ * With the wii common key the partitions of a wii image are decrypted
+ * so their blocks can be stored without the hashes and encryption
  */
-struct DiscInfo * profileImage(char *file);
+struct DiscInfo * profileImage(char *file, size_t blockSize, unsigned char *commonKey);
+
+/**
+ * Free a disc info and everything it points to except the common key,
+ * which always belongs to whoever passed it in
+ */
+void freeDiscInfo(struct DiscInfo *discInfo);
 
 /**
  * Get the disc info from the first block of data
  *
- * If this is a shrunken image call this function twice
- * with the first and second block to fill the disc info
+ * The data has to hold at least MIN_BLOCK_SIZE bytes.  If this is a
+ * shrunken image call readTable to get the rest of the partition table
+ * and then call this function again with the first data block
  */
 void getDiscInfo(struct DiscInfo *discInfo, unsigned char data[]);
 
+/**
+ * Read the rest of the partition table of a shrunken image
+ * after getDiscInfo has seen the first MIN_BLOCK_SIZE bytes
+ */
+bool readTable(struct DiscInfo *discInfo, FILE *f);
+
+/**
+ * Get the size in bytes of the full disc
+ */
+uint64_t getDiscSize(struct DiscInfo *discInfo);
+
+/**
+ * Get the number of blocks the full disc is split into
+ */
+size_t getBlockCount(struct DiscInfo *discInfo);
+
+/**
+ * Get the size of the given block, only the last block can be short
+ */
+size_t getBlockLength(struct DiscInfo *discInfo, size_t blockNum);
+
+/**
+ * Get the size of the partition table, always a whole number of blocks
+ */
+size_t getTableSize(struct DiscInfo *discInfo);
+
+/**
+ * Set the version byte of a finished partition table to the
+ * lowest version that can read everything in it
+ */
+void setShrunkenVersion(struct DiscInfo *discInfo);
+
+/**
+ * Get where the manifest starts in the partition table, right after the last entry
+ */
+size_t getManifestOffset(struct DiscInfo *discInfo);
+
+/**
+ * Once the partition table has been read up to getTableSize, pick up how
+ * many ranges the manifest has and make room for them in the table
+ *
+ * Returns the size of the table with the manifest, which is more than has
+ * been read when the manifest goes past it, or 0 if the manifest is not valid
+ */
+size_t readManifestCount(struct DiscInfo *discInfo);
+
+/**
+ * Get the first block and number of blocks of a range in the manifest
+ */
+bool getManifestRange(struct DiscInfo *discInfo, size_t index, size_t *firstBlock, size_t *blockCount);
+
+/**
+ * Replace the manifest with count ranges, each a first block and a number of
+ * blocks, in the order they were read.  A count of 0 removes the manifest
+ */
+void setManifest(struct DiscInfo *discInfo, const uint32_t *ranges, size_t count);
+
+/**
+ * Check that a block size is a power of two between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE
+ */
+bool isValidBlockSize(size_t blockSize);
+
 /**
  * Print out the disc info
  */
@@ -0,0 +1,149 @@
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "disc_info.h"
+#include "estimate.h"
+
+#define MAX_SEGMENTS_PER_BLOCK (0x100000 / JUNK_SEGMENT_SIZE)
+
+/**
+ * Print one line of the estimate as a percent of the blocks
+ */
+static void printEstimate(const char *name, size_t estimate, size_t blockCount)
+{
+    fprintf(stderr, "%-8s %6.2f%%\n", name, 100.0 * estimate / blockCount);
+}
+
+/**
+ * Estimate how much an image will shrink by sampling
+ * the start of every junk segment instead of reading it all
+ *
+ * A block is counted as junk or uniform when every sample in it agrees,
+ * and one sample that disagrees proves it is data.  The samples are always
+ * at the start of a segment so data anywhere else is never seen, which
+ * only ever makes a block look like junk, uniform or a repeat when it is
+ * not.  The estimated size is a lower bound on the real shrunken image.
+ */
+void estimateImage(char *file, size_t blockSize)
+{
+    if (file == NULL) {
+        fprintf(stderr, "ESTIMATE ERROR: estimating needs an input file\n");
+        return;
+    }
+
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "ESTIMATE ERROR: could not open %s\n", file);
+        return;
+    }
+
+    // every read is a tiny seek and read so don't let stdio read ahead
+    setvbuf(f, NULL, _IONBF, 0);
+
+    if (blockSize == 0) {
+        blockSize = BLOCK_SIZE;
+    }
+    size_t segmentsPerBlock = blockSize / JUNK_SEGMENT_SIZE;
+
+    fseeko(f, 0, SEEK_END);
+    uint64_t imageSize = ftello(f);
+    size_t blockCount = (imageSize + blockSize - 1) / blockSize;
+
+    // the disc info lives at the start of the first block
+    unsigned char *header = calloc(1, MIN_BLOCK_SIZE + 1);
+    fseeko(f, 0, SEEK_SET);
+    if (fread(header, 1, MIN_BLOCK_SIZE, f) != MIN_BLOCK_SIZE) {
+        fprintf(stderr, "ESTIMATE ERROR: could not read the disc header\n");
+        fclose(f);
+        return;
+    }
+
+    struct DiscInfo *discInfo = calloc(sizeof(struct DiscInfo), 1);
+    discInfo->blockSize = blockSize;
+    getDiscInfo(discInfo, header);
+    free(header);
+    if (discInfo->isShrunken || (!discInfo->isGC && !discInfo->isWII)) {
+        fprintf(stderr, "ESTIMATE ERROR: estimating needs a full GC or WII image\n");
+        fclose(f);
+        return;
+    }
+    discInfo->isDualLayer = imageSize > WII_DISC_SIZE;
+
+    unsigned char samples[MAX_SEGMENTS_PER_BLOCK][ESTIMATE_SAMPLE_SIZE];
+    unsigned char prevSamples[MAX_SEGMENTS_PER_BLOCK][ESTIMATE_SAMPLE_SIZE];
+    unsigned char junk[ESTIMATE_SAMPLE_SIZE];
+    bool hasPrev = false;
+
+    size_t junkCount = 0, uniformCount = 0;
+    size_t dataCount = 0, repeatCount = 0;
+    uint64_t bytesRead = 0;
+
+    for (size_t blockNum = 0; blockNum < blockCount; blockNum++) {
+        uint64_t blockOffset = (uint64_t) blockNum * blockSize;
+
+        int junkSegments = 0;
+        int uniformSegments = 0;
+        int segmentCount = 0;
+        for (size_t segment = 0; segment < segmentsPerBlock; segment++) {
+            uint64_t offset = blockOffset + (uint64_t) segment * JUNK_SEGMENT_SIZE;
+            if (offset >= imageSize) {
+                break;
+            }
+
+            fseeko(f, offset, SEEK_SET);
+            size_t read = fread(samples[segment], 1, ESTIMATE_SAMPLE_SIZE, f);
+            bytesRead += read;
+            segmentCount++;
+
+            getJunk(junk, offset, read, discInfo->discId, discInfo->discNumber);
+            if (isSame(samples[segment], junk, read)) {
+                junkSegments++;
+            }
+            // a uniform block has to repeat the same byte in every segment
+            else if (isUniform(samples[segment], read) != NULL && samples[segment][0] == samples[0][0]) {
+                uniformSegments++;
+            }
+        }
+
+        if (junkSegments == segmentCount) {
+            junkCount++;
+        } else if (uniformSegments == segmentCount) {
+            uniformCount++;
+        } else {
+            // a data block that matches the data block before it is not written again
+            if (hasPrev && memcmp(samples, prevSamples, segmentCount * ESTIMATE_SAMPLE_SIZE) == 0) {
+                repeatCount++;
+            } else {
+                dataCount++;
+            }
+            memcpy(prevSamples, samples, segmentCount * ESTIMATE_SAMPLE_SIZE);
+            hasPrev = true;
+        }
+    }
+    fclose(f);
+
+    if (discInfo->isDualLayer) fprintf(stderr, "Dual Layer ");
+    if (discInfo->isGC) fprintf(stderr, "Gamecube Image Found!!!\n");
+    if (discInfo->isWII) fprintf(stderr, "WII Image Found!!!\n");
+    fprintf(stderr, "Disc Id: %.*s\n", 6, discInfo->discId);
+    fprintf(stderr, "Disc Name: %s\n", discInfo->discName);
+    fprintf(stderr, "Disc Number: %d\n", discInfo->discNumber);
+    fprintf(stderr, "Block Size: 0x%zx\n", blockSize);
+    fprintf(stderr, "Sampled %llu of %llu bytes (%.4f%%)\n", (unsigned long long) bytesRead,
+        (unsigned long long) imageSize, 100.0 * bytesRead / imageSize);
+
+    printEstimate("Junk:", junkCount, blockCount);
+    printEstimate("Uniform:", uniformCount, blockCount);
+    printEstimate("Data:", dataCount + repeatCount, blockCount);
+    printEstimate("Repeat:", repeatCount, blockCount);
+
+    // the shrunken image is the partition table plus every data block that is not a repeat
+    uint64_t estimateSize = getTableSize(discInfo) + (uint64_t) dataCount * blockSize;
+    fprintf(stderr, "Estimated shrunken size: at least %llu bytes\n", (unsigned long long) estimateSize);
+    fprintf(stderr, "Data that is not at the start of a segment is not sampled and can only make the image bigger\n");
+}
@@ -0,0 +1,16 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stddef.h>
+
+// Bytes sampled from the start of every junk segment
+static const size_t ESTIMATE_SAMPLE_SIZE = 16;
+
+/**
+ * Estimate how much an image will shrink with the given block size,
+ * 0 for the default, by sampling the start of every junk segment
+ * instead of reading it all
+ */
+void estimateImage(char *file, size_t blockSize);
+
+#endif
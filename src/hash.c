@@ -33,12 +33,7 @@ unsigned char * isUniform(unsigned char *a, int length)
  */
 bool isSame(unsigned char * a, unsigned char * b, int length)
 {
-    for (int i = 0; i < length; i++) {
-        if (memcmp(a + i, b + i, 1) != 0) {
-            return false;
-        }
-    }
-    return true;
+    return memcmp(a, b, length) == 0;
 }
 
 /**
@@ -80,37 +75,120 @@ void a10002710(unsigned int sample, unsigned int buffer[])
 }
 
 /**
- * Get a junk block of size 262144/0X40000 for the given block, disc id, and disc number
+ * Seed the junk stream for the 0x8000 byte segment holding the
+ * stream offset and skip forward to the word holding it
  */
-unsigned char * getJunkBlock(unsigned int blockCount, unsigned char id[], unsigned char discNumber)
+static void seekJunkStream(struct JunkStream *stream)
 {
-    unsigned char * garbageBlock = calloc(1, BLOCK_SIZE);
-    
-    unsigned int buffer[0x824] = {0};
-    unsigned int sample = 0;
-    blockCount = blockCount * 8 * 0x1ef29123;
-    
-    int j = 0;
-    for (int i = 0; i < BLOCK_SIZE; i += 4) {
-        if ((i & 0x00007fff) == 0) {
-            sample = (((((unsigned int)id[2] << 0x8) | id[1]) << 0x10) | ((unsigned int)(id[3] + id[2]) << 0x8)) | (unsigned int)(id[0] + id[1]);
-            sample = ((sample ^ discNumber) * 0x260bcd5) ^ blockCount;
-            a10002710(sample, buffer);
-            j = 0x208;
-            blockCount += 0x1ef29123;
+    stream->segment = stream->offset / JUNK_SEGMENT_SIZE;
+
+    unsigned int sample = (stream->seed * 0x260bcd5) ^ (unsigned int)(stream->segment * 0x1ef29123);
+    a10002710(sample, stream->buffer);
+
+    // every 0x209 words the buffer is mixed again, including before the first word
+    unsigned int word = (stream->offset % JUNK_SEGMENT_SIZE) / 4;
+    for (unsigned int i = 0; i <= word / 0x209; i++) {
+        a100026e0(stream->buffer);
+    }
+    stream->j = word % 0x209;
+}
+
+/**
+ * Start a junk stream for the given disc id and disc number at any disc offset
+ */
+void initJunkStream(struct JunkStream *stream, unsigned char id[], unsigned char discNumber, uint64_t offset)
+{
+    unsigned int sample = (((((unsigned int)id[2] << 0x8) | id[1]) << 0x10) | ((unsigned int)(id[3] + id[2]) << 0x8)) | (unsigned int)(id[0] + id[1]);
+    stream->seed = sample ^ discNumber;
+    stream->offset = offset;
+    seekJunkStream(stream);
+}
+
+/**
+ * Fill the buffer with the next length bytes of the junk stream
+ */
+void readJunkStream(struct JunkStream *stream, unsigned char *junk, size_t length)
+{
+    while (length > 0) {
+        if (stream->offset / JUNK_SEGMENT_SIZE != stream->segment) {
+            seekJunkStream(stream);
         }
 
-        j++;
-        if (j == 0x209) {
-            a100026e0(buffer);
-            j = 0;
+        // whole words up to the end of the segment can be written straight out
+        if (stream->offset % 4 == 0 && length >= 4) {
+            size_t words = (JUNK_SEGMENT_SIZE - stream->offset % JUNK_SEGMENT_SIZE) / 4;
+            if (words > length / 4) {
+                words = length / 4;
+            }
+            for (size_t i = 0; i < words; i++) {
+                if (i > 0) {
+                    stream->j++;
+                    if (stream->j == 0x209) {
+                        a100026e0(stream->buffer);
+                        stream->j = 0;
+                    }
+                }
+                junk[0] = (unsigned char)(stream->buffer[stream->j] >> 0x18);
+                junk[1] = (unsigned char)(stream->buffer[stream->j] >> 0x12);
+                junk[2] = (unsigned char)(stream->buffer[stream->j] >> 0x08);
+                junk[3] = (unsigned char)(stream->buffer[stream->j] >> 0x00);
+                junk += 4;
+            }
+            length -= words * 4;
+            stream->offset += words * 4;
+
+            // step past the last word written unless that starts a new segment
+            if (stream->offset % JUNK_SEGMENT_SIZE != 0) {
+                stream->j++;
+                if (stream->j == 0x209) {
+                    a100026e0(stream->buffer);
+                    stream->j = 0;
+                }
+            }
+            continue;
         }
 
-        garbageBlock[i + 0] = (unsigned char)(buffer[j] >> 0x18);
-        garbageBlock[i + 1] = (unsigned char)(buffer[j] >> 0x12);
-        garbageBlock[i + 2] = (unsigned char)(buffer[j] >> 0x08);
-        garbageBlock[i + 3] = (unsigned char)(buffer[j] >> 0x00);
+        unsigned char word[4];
+        word[0] = (unsigned char)(stream->buffer[stream->j] >> 0x18);
+        word[1] = (unsigned char)(stream->buffer[stream->j] >> 0x12);
+        word[2] = (unsigned char)(stream->buffer[stream->j] >> 0x08);
+        word[3] = (unsigned char)(stream->buffer[stream->j] >> 0x00);
+
+        // the first and last words might only be partly wanted
+        size_t start = stream->offset % 4;
+        size_t count = (length < 4 - start) ? length : 4 - start;
+        memcpy(junk, word + start, count);
+        junk += count;
+        length -= count;
+        stream->offset += count;
+
+        // move on to the next word unless that starts a new segment
+        if (stream->offset % 4 == 0 && stream->offset % JUNK_SEGMENT_SIZE != 0) {
+            stream->j++;
+            if (stream->j == 0x209) {
+                a100026e0(stream->buffer);
+                stream->j = 0;
+            }
+        }
     }
+}
 
+/**
+ * Fill the buffer with length bytes of junk starting at any disc offset
+ */
+void getJunk(unsigned char *junk, uint64_t offset, size_t length, unsigned char id[], unsigned char discNumber)
+{
+    struct JunkStream stream;
+    initJunkStream(&stream, id, discNumber, offset);
+    readJunkStream(&stream, junk, length);
+}
+
+/**
+ * Get a junk block of size 262144/0X40000 for the given block, disc id, and disc number
+ */
+unsigned char * getJunkBlock(unsigned int blockCount, unsigned char id[], unsigned char discNumber)
+{
+    unsigned char * garbageBlock = calloc(1, BLOCK_SIZE);
+    getJunk(garbageBlock, (uint64_t) blockCount * BLOCK_SIZE, BLOCK_SIZE, id, discNumber);
     return garbageBlock;
-}
\ No newline at end of file
+}
@@ -2,8 +2,12 @@
 #define HASH_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+// The default block size, images can be shrunk with any block size from 0x8000 to 0x100000
 #define BLOCK_SIZE 0x40000
+#define JUNK_SEGMENT_SIZE 0x8000
 
 /**
  * Print out the unsigned character array to the given length in hex format
@@ -20,9 +24,38 @@ unsigned char * isUniform(unsigned char *a, int length);
  */
 bool isSame(unsigned char * a, unsigned char * b, int length);
 
+/**
+ * State for generating the junk stream from any disc offset
+ */
+struct JunkStream
+{
+    unsigned int buffer[0x209];
+    unsigned int seed;
+    uint64_t segment;
+    uint64_t offset;
+    int j;
+};
+
+/**
+ * Start a junk stream for the given disc id and disc number at any disc offset
+ */
+void initJunkStream(struct JunkStream *stream, unsigned char id[], unsigned char discNumber, uint64_t offset);
+
+/**
+ * Fill the buffer with the next length bytes of the junk stream
+ */
+void readJunkStream(struct JunkStream *stream, unsigned char *junk, size_t length);
+
+/**
+ * Fill the buffer with length bytes of junk starting at any disc offset
+ *
+ * Only the 0x8000 byte segments that overlap the range are generated
+ */
+void getJunk(unsigned char *junk, uint64_t offset, size_t length, unsigned char id[], unsigned char discNumber);
+
 /**
  * Get a junk block of size 262144/0X40000 for the given block, disc id, and disc number
  */
 unsigned char * getJunkBlock(unsigned int blockCount, unsigned char id[], unsigned char discNumber);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,4 +1,8 @@
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,249 +10,310 @@
 #include "hash.h"
 #include "disc_info.h"
 #include "crc32.h"
+#include "checkpoint.h"
+#include "wii.h"
+#include "osnis.h"
+
+/**
+ * A file that is read through the decoder, stdin can only go forward
+ */
+struct InputStream
+{
+    FILE *f;
+    uint64_t position;
+};
+
+/**
+ * Read from the input stream for the decoder, files can seek
+ * anywhere but stdin can only skip forward
+ */
+static size_t readStream(void *context, unsigned char *buffer, size_t length, uint64_t offset)
+{
+    struct InputStream *input = context;
+    if (offset != input->position) {
+        if (fseeko(input->f, offset, SEEK_SET) == 0) {
+            input->position = offset;
+        }
+        while (input->position < offset && getc(input->f) != EOF) {
+            input->position++;
+        }
+        if (input->position != offset) {
+            return 0;
+        }
+    }
+    size_t read = fread(buffer, 1, length, input->f);
+    input->position += read;
+    return read;
+}
+
+/**
+ * The output file, with a crc of the data after the table when checkpointing
+ */
+struct OutputStream
+{
+    FILE *f;
+    uint32_t crc;
+};
+
+/**
+ * Write what the encoder hands us to the output file
+ */
+static bool writeFile(void *context, const unsigned char *data, size_t length)
+{
+    struct OutputStream *output = context;
+    return fwrite(data, 1, length, output->f) == length;
+}
+
+/**
+ * Write data to the output file and add it to the crc a checkpoint keeps
+ */
+static bool writeChecked(void *context, const unsigned char *data, size_t length)
+{
+    struct OutputStream *output = context;
+    output->crc = crc32(data, length, output->crc);
+    return writeFile(context, data, length);
+}
 
 /**
  * Unshrink a shrunken image
+ *
+ * Images with decrypted wii partition blocks need the common key
  */
-void unshrinkImage(char *inputFile, char *outputFile) {
+void unshrinkImage(char *inputFile, char *outputFile, unsigned char *commonKey) {
 
     // if file pointer is empty read from stdin
     FILE *inputF = (inputFile != NULL) ? fopen(inputFile, "rb") : stdin;
     // if file pointer is empty write to stdout
     FILE *outputF = (outputFile != NULL) ? fopen(outputFile, "wb") : stdout;
 
-    // Do all of our reading in 0x40000 byte blocks
-    unsigned char * buffer = calloc(1, BLOCK_SIZE);
-
-    struct DiscInfo *discInfo = calloc(sizeof(struct DiscInfo), 1);
-
-    // in a shrunken image the first block is always the partition table
-    if (fread(buffer, 1, BLOCK_SIZE, inputF) != BLOCK_SIZE){
+    // the decoder reads the partition table and the first block
+    struct InputStream input = {inputF, 0};
+    struct OsnisDecoder decoder;
+    if (!osnisDecoderInit(&decoder, readStream, &input, commonKey)) {
+        fprintf(stderr, "DECODE ERROR: %s\n", decoder.error);
         fprintf(stderr, "UNSHRINK ERROR: could not read partition table\n");
+        osnisDecoderFree(&decoder);
         return;
     }
-    getDiscInfo(discInfo, buffer);
-
-    // the first block of data always exists
-    if (fread(buffer, 1, BLOCK_SIZE, inputF) != BLOCK_SIZE){
-        fprintf(stderr, "UNSHRINK ERROR: could not read first block\n");
-        return;
-    }
-    if (fwrite(buffer, 1, BLOCK_SIZE, outputF) != BLOCK_SIZE) {
-        fprintf(stderr, "UNSHRINK ERROR: could not write first block\n");
-        return;
-    }
-    getDiscInfo(discInfo, buffer);
+    struct DiscInfo *discInfo = decoder.discInfo;
     printDiscInfo(discInfo);
 
-    size_t discBlockNum = 0;
-    size_t lastBlockSize = 0;
-    if (discInfo->isWII && discInfo->isDualLayer) {
-        discBlockNum = WII_DL_BLOCK_NUM;
-        lastBlockSize = WII_DL_LAST_BLOCK_SIZE;
-    } else if(discInfo->isWII) {
-        discBlockNum = WII_BLOCK_NUM;
-        lastBlockSize = WII_LAST_BLOCK_SIZE;
-    } else if(discInfo->isGC) {
-        discBlockNum = GC_BLOCK_NUM;
-        lastBlockSize = GC_LAST_BLOCK_SIZE;
-    }
-
-    // fprintf(stderr, "discBlockNum: %zu\n", discBlockNum);
-    // fprintf(stderr, "lastBlockSize: %zx\n", lastBlockSize);
-
-    uint32_t lastAddr = 0;
-    size_t read = 0;
-    for(int blockNum = 2; blockNum <= discBlockNum; blockNum++) {
-        
-        // set the block size to write
-        size_t writeSize = (blockNum < discBlockNum) ? BLOCK_SIZE : lastBlockSize;
-
-        // if FFs we are a junk block
-        if (memcmp(&FFs, discInfo->table + (blockNum * 8), 4) == 0) {
-            // get the junk block and write it
-            unsigned char * junk = getJunkBlock(blockNum - 1, discInfo->discId, discInfo->discNumber);
-            // check the crc32 of the junk block and write if everthing is fine
-            uint32_t crc = crc32(junk, writeSize, 0);
-            if (memcmp(&crc, discInfo->table + (blockNum * 8) + 4, 4) == 0) {
-                if (fwrite(junk, writeSize, 1, outputF) != 1) {
-                    fprintf(stderr, "UNSHRINK ERROR: could not write block %d\n", blockNum);
-                    break;
-                }
-            } else {
-                uint32_t tableCrc;
-                memcpy(&tableCrc, discInfo->table + ((blockNum) * 8) + 4, 4);
-                fprintf(stderr, "UNSHRINK ERROR: junk crc error at %d\n", blockNum);
-                fprintf(stderr, "UNSHRINK ERROR: Block crc was %x but table crc was %x\n", crc, tableCrc);
-                break;
-            }
+    size_t discBlockNum = getBlockCount(discInfo);
+    for (size_t blockNum = 0; blockNum < discBlockNum; blockNum++) {
+        // every block comes back checked against the crc in the table
+        const unsigned char *block = osnisDecodeBlock(&decoder, blockNum);
+        if (block == NULL) {
+            fprintf(stderr, "DECODE ERROR: %s\n", decoder.error);
+            fprintf(stderr, "UNSHRINK ERROR: could not rebuild block %zu\n", blockNum);
+            break;
+        }
+        if (fwrite(block, getBlockLength(discInfo, blockNum), 1, outputF) != 1) {
+            fprintf(stderr, "UNSHRINK ERROR: could not write block %zu\n", blockNum);
+            break;
         }
+    }
+    fclose(inputF);
+    fclose(outputF);
+    osnisDecoderFree(&decoder);
+}
 
-        // if FEs we are a repeat junk block
-        else if (memcmp(&FEs, discInfo->table + (blockNum * 8), 4) == 0) {
-            unsigned char repeatByte = discInfo->table[((blockNum) * 8) + 7];
-            unsigned char repeat[BLOCK_SIZE] = {repeatByte};
-            if (fwrite(repeat, writeSize, 1, outputF) != 1) {
-                fprintf(stderr, "UNSHRINK ERROR: could not write block %d\n", blockNum);
-                break;
-            }
+/**
+ * Push the rest of the input through the encoder a block at a time
+ *
+ * If a checkpoint file is given the encoder state is saved to it every
+ * CHECKPOINT_INTERVAL blocks
+ */
+static bool shrinkBlocks(struct OsnisEncoder *encoder, FILE *inputF, struct OutputStream *output, char *checkpointFile) {
+
+    // Do all of our reading in blocks of the image's block size
+    size_t blockSize = encoder->discInfo->blockSize;
+    unsigned char * buffer = calloc(1, blockSize);
+
+    size_t read;
+    while((read = fread(buffer, 1, blockSize, inputF)) > 0) {
+        if (!osnisEncoderPush(encoder, buffer, read)) {
+            break;
         }
 
-        // otherwise we are a data block
-        else {
-            // only read a new block in if we are not a repeat bock
-            if (memcmp(&lastAddr, discInfo->table + (blockNum * 8), 4) != 0) {
-                if ((read = fread(buffer, 1, writeSize, inputF)) != writeSize){
-                    fprintf(stderr, "UNSHRINK ERROR: could not read block %d\n", blockNum);
-                    return;
-                }
-                if (read != writeSize) {
-                    fprintf(stderr, "UNSHRINK ERROR: %d of %zd\n", blockNum, discBlockNum);
-                    fprintf(stderr, "UNSHRINK ERROR: read %zx != write %zx\n", read, writeSize);
-                    break;
-                }
-            }
-            memcpy(&lastAddr, discInfo->table + (blockNum * 8), 4);
-            
-            // check the crc32 of the data block and write if everthing is fine
-            uint32_t crc = crc32(buffer, writeSize, 0);
-            if (memcmp(&crc, discInfo->table + (blockNum * 8) + 4, 4) == 0) {
-                if (fwrite(buffer, writeSize, 1, outputF) != 1) {
-                    fprintf(stderr, "UNSHRINK ERROR: could not write block %d\n", blockNum);
-                    break;
-                }
-            } else {
-                uint32_t tableCrc;
-                memcpy(&tableCrc, discInfo->table + (blockNum * 8) + 4, 4);
-                fprintf(stderr, "UNSHRINK ERROR: data crc error at %d\n", blockNum);
-                fprintf(stderr, "UNSHRINK ERROR: Block crc was %x but table crc was %x\n", crc, tableCrc);
-                break;
+        if (checkpointFile != NULL && read == blockSize && encoder->state.blockNum % CHECKPOINT_INTERVAL == 0) {
+            // the output has to be on disk before a checkpoint says it is
+            encoder->state.outputCrc = output->crc;
+            if (fflush(output->f) != 0 || fsync(fileno(output->f)) != 0
+                    || !writeCheckpoint(checkpointFile, &encoder->state, encoder->discInfo->table)) {
+                // an earlier checkpoint still matches the output so it can be resumed from,
+                // but without this one there is no point trying again
+                fprintf(stderr, "SHRINK ERROR: could not checkpoint block %" PRIu64 ", resuming will start from the last checkpoint written if there is one\n",
+                    encoder->state.blockNum);
+                checkpointFile = NULL;
             }
         }
     }
-    fclose(inputF);
-    fclose(outputF);
+    free(buffer);
+
+    bool finished = osnisEncoderFinish(encoder);
+    if (!finished) {
+        fprintf(stderr, "SHRINK ERROR: %s\n", encoder->error);
+    }
+    return finished && read == 0 && !ferror(inputF);
 }
 
 /**
  * Create a shrunken image from the input file and disc info
+ *
+ * If checkpoint is true a checkpoint is written next to the output
+ * file so an interrupted shrink can be resumed
  */
-void shrinkImage(struct DiscInfo * discInfo, char *inputFile, char *outputFile) {
+void shrinkImage(struct DiscInfo * discInfo, char *inputFile, char *outputFile, bool checkpoint) {
 
     if (!discInfo->isGC && !discInfo->isWII) {
         fprintf(stderr, "ERROR: We are not a GC or WII disc\n");
         return;
     }
 
+    if (checkpoint && (inputFile == NULL || outputFile == NULL)) {
+        fprintf(stderr, "SHRINK ERROR: checkpoints need an input and output file\n");
+        return;
+    }
+
     // if file pointer is empty read from stdin
     FILE *inputF = (inputFile != NULL) ? fopen(inputFile, "rb") : stdin;
     // if file pointer is empty read from stdout
     FILE *outputF = (outputFile != NULL) ? fopen(outputFile, "wb") : stdout;
 
-    // Do all of our reading in 0x40000 byte blocks
-    unsigned char * buffer = calloc(1, BLOCK_SIZE);
-    unsigned char * repeatByte;
-    
-    // write partition block
-    if (fwrite(discInfo->table, BLOCK_SIZE, 1, outputF) != 1) {
-        fprintf(stderr, "SHRINK ERROR: could not write partition table\n");
+    // the encoder checks every block against the profiled
+    // partition table and writes the table first
+    struct OutputStream output = {outputF, 0};
+    struct OsnisEncoder encoder;
+    if (!osnisEncoderInit(&encoder, discInfo, true, 0, writeFile, checkpoint ? writeChecked : writeFile, &output)) {
+        fprintf(stderr, "SHRINK ERROR: %s\n", encoder.error);
+        osnisEncoderFree(&encoder);
         return;
     }
+    char *checkpointFile = checkpoint ? getCheckpointFile(outputFile) : NULL;
 
-    size_t discBlockNum = 0;
-    size_t lastBlockSize = 0;
-    if (discInfo->isWII && discInfo->isDualLayer) {
-        discBlockNum = WII_DL_BLOCK_NUM;
-        lastBlockSize = WII_DL_LAST_BLOCK_SIZE;
-    } else if(discInfo->isWII) {
-        discBlockNum = WII_BLOCK_NUM;
-        lastBlockSize = WII_LAST_BLOCK_SIZE;
-    } else if(discInfo->isGC) {
-        discBlockNum = GC_BLOCK_NUM;
-        lastBlockSize = GC_LAST_BLOCK_SIZE;
+    // once everything is written the checkpoint is no longer needed
+    if (shrinkBlocks(&encoder, inputF, &output, checkpointFile) && checkpointFile != NULL) {
+        remove(checkpointFile);
     }
+    osnisEncoderFree(&encoder);
+    free(checkpointFile);
 
-    // fprintf(stderr, "discBlockNum: %zu\n", discBlockNum);
-    // fprintf(stderr, "lastBlockSize: %zx\n", lastBlockSize);
+    fclose(inputF);
+    fclose(outputF);
+}
 
-    uint32_t prevCrc = 0;
-    uint32_t dataBlockNum = 0;
-    size_t blockNum = 0;
-    size_t read;
-    while((read = fread(buffer, 1, BLOCK_SIZE, inputF)) > 0) {
+/**
+ * Resume an interrupted shrink from the checkpoint next to the output file
+ *
+ * A shrink that decrypted wii partitions needs the common key again
+ */
+void resumeShrinkImage(char *inputFile, char *outputFile, unsigned char *commonKey) {
 
-        // set the block size to write
-        size_t writeSize = (blockNum < discBlockNum - 1) ? BLOCK_SIZE : lastBlockSize;
+    if (inputFile == NULL || outputFile == NULL) {
+        fprintf(stderr, "SHRINK ERROR: resuming needs an input and output file\n");
+        return;
+    }
 
-        if (read != writeSize) {
-            fprintf(stderr, "SHRINK ERROR: %zd of %zd\n", blockNum, discBlockNum);
-            fprintf(stderr, "SHRINK ERROR: read %zx != write %zx\n", read, writeSize);
-        }
+    char *checkpointFile = getCheckpointFile(outputFile);
+    struct DiscInfo *discInfo = calloc(sizeof(struct DiscInfo), 1);
 
-        // get the junk block
-        unsigned char * junk = getJunkBlock(blockNum, discInfo->discId, discInfo->discNumber);
+    struct Checkpoint checkpoint;
+    unsigned char *table;
+    if (!readCheckpoint(checkpointFile, &checkpoint, &table)) {
+        return;
+    }
 
-        // get the crc32 of the data block
-        uint32_t crc = crc32(buffer, read, 0);
+    // the table in the checkpoint tells us the block size and disc type
+    getDiscInfo(discInfo, table);
+    if (discInfo->table == NULL || getTableSize(discInfo) != checkpoint.tableSize) {
+        fprintf(stderr, "SHRINK ERROR: checkpoint partition table is not valid\n");
+        return;
+    }
+    memcpy(discInfo->table, table, checkpoint.tableSize);
+    discInfo->isShrunken = false;
+    free(table);
 
-        // if this is a junk block skip writing it
-        if (isSame(buffer, junk, read)) {
-            if (memcmp(&FFs, discInfo->table + ((blockNum + 1) * 8), 4) != 0) {
-                fprintf(stderr, "SHRINK ERROR: Saw a junk block at %zu but expected something else\n", blockNum);
-                break;
-            }
-            if (memcmp(&crc, discInfo->table + ((blockNum + 1) * 8) + 4, 4) != 0) {
-                uint32_t tableCrc;
-                memcpy(&tableCrc, discInfo->table + ((blockNum + 1) * 8) + 4, 4);
-                fprintf(stderr, "SHRINK ERROR: junk crc error at %lu\n", blockNum);
-                fprintf(stderr, "SHRINK ERROR: Block crc was %x but table crc was %x\n", crc, tableCrc);
-                break;
-            }
-        }
+    FILE *inputF = fopen(inputFile, "rb");
+    FILE *outputF = fopen(outputFile, "r+b");
+    if (inputF == NULL || outputF == NULL) {
+        fprintf(stderr, "SHRINK ERROR: could not open files to resume\n");
+        return;
+    }
 
-        // if this is a repeated block just check that the partition table is correct and don't write it
-        else if((repeatByte = isUniform(buffer, read)) != NULL) {
-            if (memcmp(&FEs, discInfo->table + ((blockNum + 1) * 8), 4) != 0) {
-                fprintf(stderr, "SHRINK ERROR: Saw a repeat block at %zu but expected something else\n", blockNum);
-                break;
-            }
-            if (memcmp(repeatByte, discInfo->table + ((blockNum + 1) * 8) + 7, 1) != 0) {
-                fprintf(stderr, "SHRINK ERROR: Saw a repeat block at %zu but the repeat byte was wrong\n", blockNum);
-                break;
-            }
+    // the partial output has to start with the same partition table
+    size_t tableSize = checkpoint.tableSize;
+    unsigned char * buffer = calloc(1, (tableSize > discInfo->blockSize) ? tableSize : discInfo->blockSize);
+    if (fread(buffer, 1, tableSize, outputF) != tableSize
+            || memcmp(buffer, discInfo->table, tableSize) != 0) {
+        fprintf(stderr, "SHRINK ERROR: output partition table does not match the checkpoint\n");
+        return;
+    }
+
+    // and the partial output up to the checkpoint has to be what was written then
+    uint32_t outputCrc = 0;
+    for (uint64_t offset = tableSize; offset < checkpoint.outputOffset; ) {
+        uint64_t left = checkpoint.outputOffset - offset;
+        size_t length = (left < discInfo->blockSize) ? left : discInfo->blockSize;
+        if (fread(buffer, 1, length, outputF) != length) {
+            fprintf(stderr, "SHRINK ERROR: output is shorter than the checkpoint\n");
+            return;
         }
+        outputCrc = crc32(buffer, length, outputCrc);
+        offset += length;
+    }
+    if (outputCrc != checkpoint.outputCrc) {
+        fprintf(stderr, "SHRINK ERROR: output does not match the checkpoint\n");
+        return;
+    }
 
-        // if we got this far we should be a data block
-        // make sure our table has the correct address and crc
-        else {
-            if (prevCrc != crc) {
-                dataBlockNum++;
-            }
-            if (memcmp(&dataBlockNum, discInfo->table + ((blockNum + 1) * 8), 4) != 0) {
-                uint32_t address;
-                memcpy(&address, discInfo->table + ((blockNum + 1) * 8), 4);
-                fprintf(stderr, "SHRINK ERROR: Saw a data block but address was wrong at %zu\n", blockNum);
-                fprintf(stderr, "SHRINK ERROR: expected %u but %u is in the table\n", dataBlockNum, address);
-                break;
-            }
-            if (memcmp(&crc, discInfo->table + ((blockNum + 1) * 8) + 4, 4) != 0) {
-                uint32_t tableCrc;
-                memcpy(&tableCrc, discInfo->table + ((blockNum + 1) * 8) + 4, 4);
-                fprintf(stderr, "SHRINK ERROR: data crc error at %lu\n", blockNum);
-                fprintf(stderr, "SHRINK ERROR: Block crc was %x but table crc was %x\n", crc, tableCrc);
-                break;
-            }
-            // only write the block if this was not a repeat block
-            if (prevCrc != crc) {
-                if (fwrite(buffer, 1, writeSize, outputF) != read) {
-                    fprintf(stderr, "SHRINK ERROR: could not write data block %zu at %d\n", blockNum, dataBlockNum);
-                    break;
-                }
-            }
-            prevCrc = crc;
+    // re-read the input prefix to make sure it is the same input,
+    // this only costs reading and not junk generation or writing
+    uint32_t inputCrc = 0;
+    for (size_t blockNum = 0; blockNum < checkpoint.blockNum; blockNum++) {
+        size_t read = fread(buffer, 1, discInfo->blockSize, inputF);
+        if (read == 0) {
+            fprintf(stderr, "SHRINK ERROR: input is shorter than the checkpoint\n");
+            return;
         }
-        blockNum++;
+        if (blockNum == 0) {
+            getDiscInfo(discInfo, buffer);
+        }
+        uint32_t crc = crc32(buffer, read, 0);
+        inputCrc = crc32((unsigned char *) &crc, 4, inputCrc);
+    }
+    free(buffer);
+
+    if (inputCrc != checkpoint.inputCrc) {
+        fprintf(stderr, "SHRINK ERROR: input does not match the checkpoint\n");
+        return;
+    }
+
+    // the partitions are found again the same way profiling found them
+    if (discInfo->isWII && commonKey != NULL) {
+        discInfo->commonKey = commonKey;
+        readWiiPartitions(discInfo, inputFile);
+    }
+
+    printDiscInfo(discInfo);
+    fprintf(stderr, "Resuming at block %" PRIu64 "\n", checkpoint.blockNum);
+
+    // the table is already written so the encoder only writes data
+    // and carries on from the state in the checkpoint
+    fseeko(outputF, checkpoint.outputOffset, SEEK_SET);
+    struct OutputStream output = {outputF, checkpoint.outputCrc};
+    struct OsnisEncoder encoder;
+    if (!osnisEncoderInit(&encoder, discInfo, true, 0, NULL, writeChecked, &output)) {
+        fprintf(stderr, "SHRINK ERROR: %s\n", encoder.error);
+        osnisEncoderFree(&encoder);
+        return;
     }
+    encoder.state = checkpoint;
+    if (shrinkBlocks(&encoder, inputF, &output, checkpointFile)) {
+        remove(checkpointFile);
+    }
+    osnisEncoderFree(&encoder);
+    free(checkpointFile);
+
     fclose(inputF);
     fclose(outputF);
-}
\ No newline at end of file
+}
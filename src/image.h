@@ -5,12 +5,24 @@
 
 /**
  * Unshrink a shrunken image
+ *
+ * Images with decrypted wii partition blocks need the common key
  */
-void unshrinkImage(char *inputFile, char *outputFile);
+void unshrinkImage(char *inputFile, char *outputFile, unsigned char *commonKey);
 
 /**
  * Create a shrunken image from the input file and disc info
+ *
+ * If checkpoint is true a checkpoint is written next to the output
+ * file so an interrupted shrink can be resumed
  */
-void shrinkImage(struct DiscInfo * discInfo, char *inputFile, char *outputFile);
+void shrinkImage(struct DiscInfo * discInfo, char *inputFile, char *outputFile, bool checkpoint);
+
+/**
+ * Resume an interrupted shrink from the checkpoint next to the output file
+ *
+ * A shrink that decrypted wii partitions needs the common key again
+ */
+void resumeShrinkImage(char *inputFile, char *outputFile, unsigned char *commonKey);
 
 #endif
\ No newline at end of file
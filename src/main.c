@@ -7,27 +7,68 @@
 #include "image.h"
 #include "disc_info.h"
 #include "crc32.h"
+#include "estimate.h"
+#include "tune.h"
+#include "manifest.h"
+#include "wii.h"
 
 int main(int argc, char *argv[])
 {
     char *inputFile = NULL;
     char *outputFile = NULL;
+    char *traceFile = NULL;
     bool doProfile = false;
+    bool doEstimate = false;
     bool doShrink = false;
     bool doUnshrink = false;
+    bool doCheckpoint = false;
+    bool doResume = false;
+    bool doTune = false;
+    size_t blockSize = 0;
+    unsigned char key[16];
+    unsigned char *commonKey = NULL;
 
     int opt;
-    while ((opt = getopt(argc, argv, "i:o:hpsu")) != -1) {
+    while ((opt = getopt(argc, argv, "b:i:k:m:o:cehprsu")) != -1) {
         switch (opt) {
             case 'p':
                 doProfile = true;
                 break;
+            case 'e':
+                doEstimate = true;
+                break;
             case 's':
                 doShrink = true;
                 break;
             case 'u':
                 doUnshrink = true;
                 break;
+            case 'c':
+                doCheckpoint = true;
+                break;
+            case 'r':
+                doResume = true;
+                break;
+            case 'b':
+                if (strcmp(optarg, "auto") == 0) {
+                    doTune = true;
+                    break;
+                }
+                blockSize = strtoul(optarg, NULL, 0);
+                if (!isValidBlockSize(blockSize)) {
+                    fprintf(stderr, "Block size must be a power of two from 0x%zx to 0x%zx or auto\n", MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+                    return 1;
+                }
+                break;
+            case 'k':
+                if (!readCommonKey(optarg, key)) {
+                    return 1;
+                }
+                commonKey = key;
+                break;
+            case 'm':
+                traceFile = optarg;
+                break;
             case 'i':
                 inputFile = optarg; 
                 break;
@@ -35,27 +76,55 @@ int main(int argc, char *argv[])
                 outputFile = optarg;
                 break;
             case '?':
-                if (optopt == 'i' || optopt == 'i') {
+                if (optopt == 'i' || optopt == 'o' || optopt == 'b' || optopt == 'k' || optopt == 'm') {
                     fprintf (stderr, "Option -%c requires an argument.\n", optopt);
                 }
             case 'h':
             default:
-                fprintf(stderr, "Usage: %s -s|-u [-i inputFile] [-o outputFile]\n", argv[0]);
+                fprintf(stderr, "Usage: %s -p|-e|-s [-c|-r]|-u|-m traceFile [-b blockSize|auto] [-k keyFile] [-i inputFile] [-o outputFile]\n", argv[0]);
                 return 1;
             }
     }
 
-    if (doProfile) {
-        struct DiscInfo * discInfo = profileImage(inputFile);
+    // Checkpoints and resuming only make sense for a shrink
+    if (doCheckpoint || doResume) {
+        doShrink = true;
+    }
+
+    // Picking the block size reads the whole image, which would defeat
+    // the point of sampling, so it is only for shrinking
+    if (doTune && (doEstimate || doProfile) && traceFile == NULL) {
+        fprintf(stderr, "Block size auto only works when shrinking, pick a block size to estimate or profile with\n");
+        return 1;
+    }
+
+    // Picking the block size reads the whole image once more before anything else
+    if (doTune && doShrink && !doResume && traceFile == NULL) {
+        if ((blockSize = tuneBlockSize(inputFile)) == 0) {
+            return 1;
+        }
+    }
+
+    if (traceFile != NULL) {
+        // Adding a manifest only rewrites the partition table of a shrunken image
+        manifestImage(traceFile, inputFile, outputFile);
+    } else if (doEstimate) {
+        // Estimating only samples the image so it needs a real file
+        estimateImage(inputFile, blockSize);
+    } else if (doProfile) {
+        struct DiscInfo * discInfo = profileImage(inputFile, blockSize, commonKey);
         printDiscInfo(discInfo);
+    } else if(doShrink && doResume){
+        // Resuming picks up the table from the checkpoint so no profiling is needed
+        resumeShrinkImage(inputFile, outputFile, commonKey);
     } else if(doShrink){
         // Creating a shrunken image will take two passes.
         // One to prifile the disc and one to write the shrunken image
-        struct DiscInfo * discInfo = profileImage(inputFile);
+        struct DiscInfo * discInfo = profileImage(inputFile, blockSize, commonKey);
         printDiscInfo(discInfo);
-        shrinkImage(discInfo, inputFile, outputFile);
+        shrinkImage(discInfo, inputFile, outputFile, doCheckpoint);
     } else if(doUnshrink){
         // Unshrinking an image can be done in a single pass
-        unshrinkImage(inputFile, outputFile);
+        unshrinkImage(inputFile, outputFile, commonKey);
     }
 }
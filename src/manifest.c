@@ -0,0 +1,133 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "disc_info.h"
+#include "manifest.h"
+
+/**
+ * Turn the reads in a trace into ranges of blocks in the order they were
+ * first read, a block that follows the last range just makes it longer
+ *
+ * Returns the number of ranges, each a first block and a number of blocks
+ */
+static size_t readTrace(FILE *f, struct DiscInfo *discInfo, uint32_t **ranges)
+{
+    size_t blockCount = getBlockCount(discInfo);
+    bool *seen = calloc(blockCount, sizeof(bool));
+    size_t count = 0;
+    size_t capacity = 0;
+    *ranges = NULL;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        // anything that is not an offset and a length is skipped
+        char *end;
+        char *lengthStart;
+        uint64_t offset = strtoull(line, &lengthStart, 0);
+        uint64_t length = strtoull(lengthStart, &end, 0);
+        if (lengthStart == line || end == lengthStart || length == 0) {
+            continue;
+        }
+
+        uint64_t firstBlock = offset / discInfo->blockSize;
+        uint64_t lastBlock = (offset + length - 1) / discInfo->blockSize;
+        if (lastBlock >= blockCount) {
+            lastBlock = blockCount - 1;
+        }
+        for (uint64_t blockNum = firstBlock; blockNum <= lastBlock; blockNum++) {
+            if (seen[blockNum]) {
+                continue;
+            }
+            seen[blockNum] = true;
+
+            if (count > 0 && (*ranges)[(count - 1) * 2] + (*ranges)[(count - 1) * 2 + 1] == blockNum) {
+                (*ranges)[(count - 1) * 2 + 1]++;
+                continue;
+            }
+            if (count == capacity) {
+                capacity = (capacity == 0) ? 64 : capacity * 2;
+                *ranges = realloc(*ranges, capacity * 2 * sizeof(uint32_t));
+            }
+            (*ranges)[count * 2] = blockNum;
+            (*ranges)[count * 2 + 1] = 1;
+            count++;
+        }
+    }
+    free(seen);
+    return count;
+}
+
+/**
+ * Copy a shrunken image with a manifest of the blocks read in the trace file
+ *
+ * Each line of the trace is the offset and length of one read of the
+ * original image.  The blocks are listed in the order they were first
+ * read so readers can decode them ahead of a session that reads the same
+ * way.  An empty trace removes the manifest
+ */
+void manifestImage(char *traceFile, char *inputFile, char *outputFile)
+{
+    FILE *traceF = fopen(traceFile, "r");
+    if (traceF == NULL) {
+        fprintf(stderr, "MANIFEST ERROR: could not open trace %s\n", traceFile);
+        return;
+    }
+
+    // if file pointer is empty read from stdin
+    FILE *inputF = (inputFile != NULL) ? fopen(inputFile, "rb") : stdin;
+    if (inputF == NULL) {
+        fprintf(stderr, "MANIFEST ERROR: could not open %s\n", inputFile);
+        fclose(traceF);
+        return;
+    }
+
+    // the manifest goes in the partition table so read all of it,
+    // along with any manifest that is already there
+    struct DiscInfo *discInfo = calloc(sizeof(struct DiscInfo), 1);
+    unsigned char *buffer = calloc(1, MAX_BLOCK_SIZE);
+    if (fread(buffer, 1, MIN_BLOCK_SIZE, inputF) != MIN_BLOCK_SIZE) {
+        fprintf(stderr, "MANIFEST ERROR: could not read partition table\n");
+        return;
+    }
+    getDiscInfo(discInfo, buffer);
+    if (!discInfo->isShrunken || discInfo->table == NULL) {
+        fprintf(stderr, "MANIFEST ERROR: this is not a shrunken image\n");
+        return;
+    }
+    if (!readTable(discInfo, inputF)) {
+        return;
+    }
+
+    uint32_t *ranges;
+    size_t count = readTrace(traceF, discInfo, &ranges);
+    fclose(traceF);
+    setManifest(discInfo, ranges, count);
+    free(ranges);
+
+    // if file pointer is empty write to stdout
+    FILE *outputF = (outputFile != NULL) ? fopen(outputFile, "wb") : stdout;
+    if (outputF == NULL) {
+        fprintf(stderr, "MANIFEST ERROR: could not open %s\n", outputFile);
+        return;
+    }
+
+    // the data blocks are found from the end of the table
+    // so they can be copied over as they are
+    size_t tableSize = getTableSize(discInfo);
+    bool written = fwrite(discInfo->table, 1, tableSize, outputF) == tableSize;
+    size_t read;
+    while (written && (read = fread(buffer, 1, MAX_BLOCK_SIZE, inputF)) > 0) {
+        written = fwrite(buffer, 1, read, outputF) == read;
+    }
+    if (!written || ferror(inputF)) {
+        fprintf(stderr, "MANIFEST ERROR: could not copy the shrunken image\n");
+    } else {
+        fprintf(stderr, "Manifest of %zu ranges written\n", count);
+    }
+
+    fclose(inputF);
+    fclose(outputF);
+    free(buffer);
+    freeDiscInfo(discInfo);
+}
@@ -0,0 +1,14 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+/**
+ * Copy a shrunken image with a manifest of the blocks read in the trace file
+ *
+ * Each line of the trace is the offset and length of one read of the
+ * original image.  The blocks are listed in the order they were first
+ * read so readers can decode them ahead of a session that reads the same
+ * way.  An empty trace removes the manifest
+ */
+void manifestImage(char *traceFile, char *inputFile, char *outputFile);
+
+#endif
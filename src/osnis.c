@@ -0,0 +1,651 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "disc_info.h"
+#include "crc32.h"
+#include "classify.h"
+#include "wii.h"
+#include "osnis.h"
+
+/**
+ * Keep why the encoder or decoder stopped for the caller to report
+ */
+static void setError(char *error, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, OSNIS_ERROR_SIZE, format, args);
+    va_end(args);
+}
+
+/**
+ * Hand data to a write callback if there is one
+ */
+static bool emit(OsnisWrite write, void *context, const unsigned char *data, size_t length)
+{
+    return write == NULL || write(context, data, length);
+}
+
+/**
+ * Add a block to the table as it goes by, the same way profiling always has
+ */
+static bool buildBlock(struct OsnisEncoder *encoder, const unsigned char *block, size_t length, uint32_t *crc)
+{
+    struct DiscInfo *discInfo = encoder->discInfo;
+    struct Checkpoint *state = &encoder->state;
+    size_t blockNum = state->blockNum;
+    unsigned char *entry = discInfo->table + ((blockNum + 1) * 8);
+
+    // blocks inside a partition that can be rebuilt are stored decrypted
+    struct WiiPartition *partition = (encoder->record != NULL) ? getWiiPartition(discInfo, blockNum) : NULL;
+    unsigned char marker;
+    size_t recordSize;
+    if (partition != NULL && length == discInfo->blockSize
+            && (recordSize = shrinkWiiBlock(discInfo, partition, blockNum, block, encoder->record, &marker)) > 0) {
+        *crc = crc32(block, length, 0);
+        state->dataBlockNum++;
+
+        // the block number only takes 3 bytes so the marker fits in the 4th
+        memcpy(entry, &state->dataBlockNum, 3);
+        entry[3] = marker;
+        memcpy(entry + 4, crc, 4);
+
+        // a data block after this can not be a repeat of it
+        state->prevCrc = 0;
+        state->outputOffset += recordSize;
+        return emit(encoder->writeData, encoder->context, encoder->record, recordSize);
+    }
+
+    // compare against the junk for this block number, only as much as we have,
+    // check for a repeated byte and get the crc all in one pass
+    // for the purposes of getting junk the blockNum starts at 0
+    struct BlockClass blockClass = classifyBlock(block, length, (uint64_t) blockNum * discInfo->blockSize,
+        discInfo->discId, discInfo->discNumber);
+    *crc = blockClass.crc;
+
+    // check if this is a junk block
+    if (blockClass.kind == BLOCK_JUNK) {
+        // Write ffs to the partition table for the address and the crc of the junk block
+        memcpy(entry, &FFs, 4);
+        memcpy(entry + 4, &blockClass.crc, 4);
+    }
+
+    // check if this is a block of repeated junk byte
+    else if (blockClass.kind == BLOCK_UNIFORM) {
+        // write our repeated byte to the partition table
+        memcpy(entry, &FEs, 4);
+        entry[7] = blockClass.repeatByte;
+    }
+
+    // If this is not a junk block then it is a data block
+    else {
+        // only advance the block number and write the block if this was not a repeat block
+        bool isRepeat = state->prevCrc == blockClass.crc;
+        if (!isRepeat) {
+            state->dataBlockNum++;
+        }
+        state->prevCrc = blockClass.crc;
+
+        // copy the block number and crc to the table
+        memcpy(entry, &state->dataBlockNum, 4);
+        memcpy(entry + 4, &blockClass.crc, 4);
+
+        if (!isRepeat) {
+            state->outputOffset += length;
+            return emit(encoder->writeData, encoder->context, block, length);
+        }
+    }
+    return true;
+}
+
+/**
+ * Check a block against the table from profiling and write it,
+ * the same way shrinking always has
+ */
+static bool verifyBlock(struct OsnisEncoder *encoder, const unsigned char *block, size_t length, uint32_t *crc)
+{
+    struct DiscInfo *discInfo = encoder->discInfo;
+    struct Checkpoint *state = &encoder->state;
+    size_t blockNum = state->blockNum;
+    unsigned char *entry = discInfo->table + ((blockNum + 1) * 8);
+
+    // set the block size to write
+    size_t writeSize = getBlockLength(discInfo, blockNum);
+    if (length != writeSize) {
+        setError(encoder->error, "block %zu of %zu was 0x%zx bytes but should be 0x%zx",
+            blockNum, getBlockCount(discInfo), length, writeSize);
+        return false;
+    }
+
+    // partition blocks have their own junk once decrypted so only their crc is needed here
+    bool isPartition = isWiiPartitionMarker(entry[3]);
+
+    // classify the block and get its crc32 in one pass
+    struct BlockClass blockClass = {0, BLOCK_DATA, 0};
+    if (isPartition) {
+        blockClass.crc = crc32(block, length, 0);
+    } else {
+        blockClass = classifyBlock(block, length, (uint64_t) blockNum * discInfo->blockSize, discInfo->discId, discInfo->discNumber);
+    }
+    *crc = blockClass.crc;
+
+    // if this is a partition block decrypt it and write the record
+    if (isPartition) {
+        struct WiiPartition *partition = (encoder->record != NULL) ? getWiiPartition(discInfo, blockNum) : NULL;
+        unsigned char marker = 0;
+        size_t recordSize = 0;
+        if (partition != NULL && length == discInfo->blockSize) {
+            recordSize = shrinkWiiBlock(discInfo, partition, blockNum, block, encoder->record, &marker);
+        }
+        if (recordSize == 0 || marker != entry[3]) {
+            setError(encoder->error, "Saw a partition block at %zu but could not decrypt it the same way", blockNum);
+            return false;
+        }
+        state->dataBlockNum++;
+        if (memcmp(&state->dataBlockNum, entry, 3) != 0) {
+            setError(encoder->error, "Saw a partition block but address was wrong at %zu", blockNum);
+            return false;
+        }
+        if (memcmp(crc, entry + 4, 4) != 0) {
+            uint32_t tableCrc;
+            memcpy(&tableCrc, entry + 4, 4);
+            setError(encoder->error, "partition crc error at %zu, block crc was %x but table crc was %x",
+                blockNum, *crc, tableCrc);
+            return false;
+        }
+        if (!emit(encoder->writeData, encoder->context, encoder->record, recordSize)) {
+            setError(encoder->error, "could not write partition block %zu at %u", blockNum, state->dataBlockNum);
+            return false;
+        }
+        state->outputOffset += recordSize;
+        state->prevCrc = 0;
+    }
+
+    // if this is a junk block skip writing it
+    else if (blockClass.kind == BLOCK_JUNK) {
+        if (memcmp(&FFs, entry, 4) != 0) {
+            setError(encoder->error, "Saw a junk block at %zu but expected something else", blockNum);
+            return false;
+        }
+        if (memcmp(crc, entry + 4, 4) != 0) {
+            uint32_t tableCrc;
+            memcpy(&tableCrc, entry + 4, 4);
+            setError(encoder->error, "junk crc error at %zu, block crc was %x but table crc was %x",
+                blockNum, *crc, tableCrc);
+            return false;
+        }
+    }
+
+    // if this is a repeated block just check that the partition table is correct and don't write it
+    else if (blockClass.kind == BLOCK_UNIFORM) {
+        if (memcmp(&FEs, entry, 4) != 0) {
+            setError(encoder->error, "Saw a repeat block at %zu but expected something else", blockNum);
+            return false;
+        }
+        if (blockClass.repeatByte != entry[7]) {
+            setError(encoder->error, "Saw a repeat block at %zu but the repeat byte was wrong", blockNum);
+            return false;
+        }
+    }
+
+    // if we got this far we should be a data block
+    // make sure our table has the correct address and crc
+    else {
+        if (state->prevCrc != *crc) {
+            state->dataBlockNum++;
+        }
+        if (memcmp(&state->dataBlockNum, entry, 4) != 0) {
+            uint32_t address;
+            memcpy(&address, entry, 4);
+            setError(encoder->error, "Saw a data block but address was wrong at %zu, expected %u but %u is in the table",
+                blockNum, state->dataBlockNum, address);
+            return false;
+        }
+        if (memcmp(crc, entry + 4, 4) != 0) {
+            uint32_t tableCrc;
+            memcpy(&tableCrc, entry + 4, 4);
+            setError(encoder->error, "data crc error at %zu, block crc was %x but table crc was %x",
+                blockNum, *crc, tableCrc);
+            return false;
+        }
+        // only write the block if this was not a repeat block
+        if (state->prevCrc != *crc) {
+            if (!emit(encoder->writeData, encoder->context, block, length)) {
+                setError(encoder->error, "could not write data block %zu at %u", blockNum, state->dataBlockNum);
+                return false;
+            }
+            state->outputOffset += length;
+        }
+        state->prevCrc = *crc;
+    }
+    return true;
+}
+
+/**
+ * Encode one whole block, only the last block of the disc can be short
+ */
+static bool encodeBlock(struct OsnisEncoder *encoder, const unsigned char *block, size_t length)
+{
+    // without a disc info the start of the first block has everything we need
+    if (encoder->discInfo == NULL) {
+        if (length < MIN_BLOCK_SIZE) {
+            setError(encoder->error, "could not read the first block");
+            return false;
+        }
+        encoder->discInfo = calloc(sizeof(struct DiscInfo), 1);
+        encoder->ownsDiscInfo = true;
+        encoder->discInfo->blockSize = encoder->blockSize;
+        getDiscInfo(encoder->discInfo, (unsigned char *) block);
+    }
+    struct DiscInfo *discInfo = encoder->discInfo;
+    if (discInfo->table == NULL || discInfo->isShrunken) {
+        setError(encoder->error, "We are not a GC or WII disc");
+        return false;
+    }
+
+    // until the whole disc has been seen a wii disc could still be dual layer
+    uint64_t maxSize = (encoder->verify || discInfo->isGC) ? getDiscSize(discInfo) : WII_DL_DISC_SIZE;
+    if ((uint64_t) encoder->state.blockNum * discInfo->blockSize >= maxSize) {
+        setError(encoder->error, "there is more data than fits on the disc");
+        return false;
+    }
+
+    uint32_t crc;
+    bool encoded = encoder->verify ? verifyBlock(encoder, block, length, &crc) : buildBlock(encoder, block, length, &crc);
+    if (!encoded) {
+        return false;
+    }
+
+    // the input crc covers every block we have seen so a resume
+    // can tell if it is looking at the same input
+    encoder->state.inputCrc = crc32((unsigned char *) &crc, 4, encoder->state.inputCrc);
+    encoder->state.blockNum++;
+    encoder->inputSize += length;
+    return true;
+}
+
+/**
+ * Start encoding
+ */
+bool osnisEncoderInit(struct OsnisEncoder *encoder, struct DiscInfo *discInfo, bool verify, size_t blockSize,
+        OsnisWrite writeTable, OsnisWrite writeData, void *context)
+{
+    memset(encoder, 0, sizeof(struct OsnisEncoder));
+    encoder->discInfo = discInfo;
+    encoder->verify = verify;
+    encoder->writeTable = writeTable;
+    encoder->writeData = writeData;
+    encoder->context = context;
+
+    if (verify && (discInfo == NULL || discInfo->table == NULL)) {
+        setError(encoder->error, "verifying needs a profiled disc");
+        return false;
+    }
+    if (discInfo != NULL) {
+        blockSize = discInfo->blockSize;
+    } else if (blockSize == 0) {
+        blockSize = BLOCK_SIZE;
+    }
+
+    encoder->blockSize = blockSize;
+    encoder->block = malloc(blockSize);
+    if (discInfo != NULL && discInfo->partitionCount > 0) {
+        encoder->record = malloc(getWiiRecordSize(blockSize, WII_PARTITION_DATA));
+    }
+
+    // when verifying the table is already known so it goes first
+    if (verify) {
+        size_t tableSize = getTableSize(discInfo);
+        encoder->state.tableSize = tableSize;
+        encoder->state.outputOffset = tableSize;
+        if (!emit(writeTable, context, discInfo->table, tableSize)) {
+            setError(encoder->error, "could not write partition table");
+            encoder->failed = true;
+            osnisEncoderFinish(encoder);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Push the next length bytes of the original image
+ *
+ * Whole blocks are encoded straight from the pushed data, only
+ * blocks split over more than one push are copied
+ */
+bool osnisEncoderPush(struct OsnisEncoder *encoder, const unsigned char *data, size_t length)
+{
+    size_t blockSize = encoder->blockSize;
+    while (length > 0 && !encoder->failed) {
+        if (encoder->filled == 0 && length >= blockSize) {
+            encoder->failed = !encodeBlock(encoder, data, blockSize);
+            data += blockSize;
+            length -= blockSize;
+            continue;
+        }
+
+        size_t count = blockSize - encoder->filled;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(encoder->block + encoder->filled, data, count);
+        encoder->filled += count;
+        data += count;
+        length -= count;
+
+        if (encoder->filled == blockSize) {
+            encoder->failed = !encodeBlock(encoder, encoder->block, blockSize);
+            encoder->filled = 0;
+        }
+    }
+    return !encoder->failed;
+}
+
+/**
+ * Encode whatever is left and write the table if it was built as the data went by
+ *
+ * The disc info stays around for the caller
+ */
+bool osnisEncoderFinish(struct OsnisEncoder *encoder)
+{
+    if (!encoder->failed && encoder->filled > 0) {
+        encoder->failed = !encodeBlock(encoder, encoder->block, encoder->filled);
+        encoder->filled = 0;
+    }
+
+    struct DiscInfo *discInfo = encoder->discInfo;
+    if (!encoder->failed && !encoder->verify && discInfo != NULL && discInfo->table != NULL) {
+        if (encoder->inputSize > WII_DISC_SIZE) {
+            discInfo->isDualLayer = true;
+        }
+
+        // set the disc type
+        if (discInfo->isWII && discInfo->isDualLayer) {
+            discInfo->table[7] = WII_DL_DISC;
+        } else if (discInfo->isWII) {
+            discInfo->table[7] = WII_DISC;
+        } else if (discInfo->isGC) {
+            discInfo->table[7] = GC_DISC;
+        }
+        setShrunkenVersion(discInfo);
+
+        encoder->state.tableSize = getTableSize(discInfo);
+        if (!emit(encoder->writeTable, encoder->context, discInfo->table, encoder->state.tableSize)) {
+            setError(encoder->error, "could not write partition table");
+            encoder->failed = true;
+        }
+    }
+
+    free(encoder->block);
+    free(encoder->record);
+    encoder->block = NULL;
+    encoder->record = NULL;
+    return !encoder->failed;
+}
+
+/**
+ * Free everything the encoder allocated, including the disc info if it made it
+ */
+void osnisEncoderFree(struct OsnisEncoder *encoder)
+{
+    free(encoder->block);
+    free(encoder->record);
+    if (encoder->ownsDiscInfo) {
+        freeDiscInfo(encoder->discInfo);
+    }
+    memset(encoder, 0, sizeof(struct OsnisEncoder));
+}
+
+/**
+ * Read exactly length bytes through the read callback
+ */
+static bool readExactly(struct OsnisDecoder *decoder, unsigned char *buffer, size_t length, uint64_t offset)
+{
+    return decoder->read(decoder->context, buffer, length, offset) == length;
+}
+
+/**
+ * Start decoding, this reads the table and the first block
+ *
+ * The table only says which stored block a data entry uses, so walk it
+ * once to find where every block starts in the shrunken image
+ */
+bool osnisDecoderInit(struct OsnisDecoder *decoder, OsnisRead read, void *context, unsigned char *commonKey)
+{
+    memset(decoder, 0, sizeof(struct OsnisDecoder));
+    decoder->read = read;
+    decoder->context = context;
+    decoder->blockNum = SIZE_MAX;
+    decoder->dataBlockNum = SIZE_MAX;
+
+    // in a shrunken image the first block is always the partition table
+    // and the start of it tells us the block size and how long the table is
+    unsigned char header[MIN_BLOCK_SIZE];
+    struct DiscInfo *discInfo = calloc(sizeof(struct DiscInfo), 1);
+    decoder->discInfo = discInfo;
+    if (!readExactly(decoder, header, MIN_BLOCK_SIZE, 0)) {
+        setError(decoder->error, "could not read partition table");
+        return false;
+    }
+    getDiscInfo(discInfo, header);
+    if (!discInfo->isShrunken || discInfo->table == NULL) {
+        setError(decoder->error, "this is not a shrunken image");
+        return false;
+    }
+    size_t tableSize = getTableSize(discInfo);
+    if (!readExactly(decoder, discInfo->table + MIN_BLOCK_SIZE, tableSize - MIN_BLOCK_SIZE, MIN_BLOCK_SIZE)) {
+        setError(decoder->error, "could not read partition table");
+        return false;
+    }
+
+    // a manifest after the entries can make the table longer
+    size_t fullSize = readManifestCount(discInfo);
+    if (fullSize == 0 || !readExactly(decoder, discInfo->table + tableSize, fullSize - tableSize, tableSize)) {
+        setError(decoder->error, "could not read manifest");
+        return false;
+    }
+    tableSize = fullSize;
+
+    // the first block of data always exists and has the disc id,
+    // keep it so a stream never has to go back for it
+    decoder->block = malloc(discInfo->blockSize);
+    decoder->data = malloc(discInfo->blockSize);
+    if (!readExactly(decoder, decoder->data, discInfo->blockSize, tableSize)) {
+        setError(decoder->error, "could not read first block");
+        return false;
+    }
+    decoder->dataOffset = tableSize;
+    getDiscInfo(discInfo, decoder->data);
+    discInfo->commonKey = commonKey;
+    decoder->record = malloc(getWiiRecordSize(discInfo->blockSize, WII_PARTITION_DATA));
+
+    size_t blockCount = getBlockCount(discInfo);
+    decoder->offsets = calloc(blockCount, sizeof(uint64_t));
+
+    uint64_t offset = tableSize;
+    uint64_t lastOffset = offset;
+    uint32_t lastAddr = 0;
+    for (size_t blockNum = 0; blockNum < blockCount; blockNum++) {
+        unsigned char *entry = discInfo->table + ((blockNum + 1) * 8);
+        if (memcmp(&ZEROs, entry, 8) == 0) {
+            break;
+        }
+        if (memcmp(&FFs, entry, 4) == 0 || memcmp(&FEs, entry, 4) == 0) {
+            continue;
+        }
+        if (isWiiPartitionMarker(entry[3])) {
+            decoder->offsets[blockNum] = offset;
+            offset += getWiiRecordSize(discInfo->blockSize, entry[3]);
+            memcpy(&lastAddr, entry, 4);
+            continue;
+        }
+
+        // a data block with the same address as the last one is a repeat
+        if (memcmp(&lastAddr, entry, 4) != 0) {
+            lastOffset = offset;
+            offset += getBlockLength(discInfo, blockNum);
+        }
+        decoder->offsets[blockNum] = lastOffset;
+        memcpy(&lastAddr, entry, 4);
+    }
+
+    // lay the manifest out a block at a time, a block only
+    // counts the first time the session read it
+    if (discInfo->manifestCount > 0) {
+        decoder->manifest = malloc(blockCount * sizeof(uint32_t));
+        decoder->manifestPosition = malloc(blockCount * sizeof(uint32_t));
+        memset(decoder->manifestPosition, 0xFF, blockCount * sizeof(uint32_t));
+        for (size_t i = 0; i < discInfo->manifestCount; i++) {
+            size_t firstBlock, rangeCount;
+            if (!getManifestRange(discInfo, i, &firstBlock, &rangeCount)) {
+                setError(decoder->error, "manifest range %zu is not valid", i);
+                return false;
+            }
+            for (size_t blockNum = firstBlock; blockNum < firstBlock + rangeCount; blockNum++) {
+                if (decoder->manifestPosition[blockNum] == UINT32_MAX) {
+                    decoder->manifestPosition[blockNum] = decoder->manifestLength;
+                    decoder->manifest[decoder->manifestLength++] = blockNum;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Decode a block of the original image
+ *
+ * Returns the block, getBlockLength bytes long, which stays valid
+ * until the next call or NULL if it could not be decoded
+ */
+const unsigned char * osnisDecodeBlock(struct OsnisDecoder *decoder, size_t blockNum)
+{
+    struct DiscInfo *discInfo = decoder->discInfo;
+    size_t length = getBlockLength(discInfo, blockNum);
+    if (length == 0) {
+        return NULL;
+    }
+
+    // reading a block a piece at a time only decodes it once, and a
+    // stream never has to go back for it
+    if (blockNum == decoder->blockNum) {
+        return decoder->block;
+    }
+    if (blockNum == decoder->dataBlockNum) {
+        return decoder->data;
+    }
+
+    unsigned char *entry = discInfo->table + ((blockNum + 1) * 8);
+    unsigned char *block = decoder->block;
+    decoder->blockNum = SIZE_MAX;
+
+    // if FEs we are a repeat junk block
+    if (memcmp(&FEs, entry, 4) == 0) {
+        memset(block, entry[7], length);
+        decoder->blockNum = blockNum;
+        return block;
+    }
+
+    // if FFs we are a junk block
+    if (memcmp(&FFs, entry, 4) == 0) {
+        getJunk(block, (uint64_t) blockNum * discInfo->blockSize, length, discInfo->discId, discInfo->discNumber);
+    }
+
+    // if the 4th byte is a partition marker we are a decrypted wii partition block
+    else if (isWiiPartitionMarker(entry[3])) {
+        size_t recordSize = getWiiRecordSize(discInfo->blockSize, entry[3]);
+        if (!readExactly(decoder, decoder->record, recordSize, decoder->offsets[blockNum])) {
+            setError(decoder->error, "could not read block %zu", blockNum);
+            return NULL;
+        }
+        if (!unshrinkWiiBlock(discInfo, blockNum, entry[3], decoder->record, block)) {
+            setError(decoder->error, "block %zu is a decrypted wii partition block, rebuilding it needs the common key", blockNum);
+            return NULL;
+        }
+    }
+
+    // otherwise we are a data block, repeat blocks are still in the buffer
+    else {
+        block = decoder->data;
+        decoder->dataBlockNum = SIZE_MAX;
+        if (decoder->offsets[blockNum] != decoder->dataOffset) {
+            decoder->dataOffset = 0;
+            if (memcmp(&ZEROs, entry, 8) == 0 || !readExactly(decoder, block, length, decoder->offsets[blockNum])) {
+                setError(decoder->error, "could not read block %zu", blockNum);
+                return NULL;
+            }
+            decoder->dataOffset = decoder->offsets[blockNum];
+        }
+    }
+
+    // check the crc32 and only hand the block out if everthing is fine
+    uint32_t crc = crc32(block, length, 0);
+    if (memcmp(&crc, entry + 4, 4) != 0) {
+        uint32_t tableCrc;
+        memcpy(&tableCrc, entry + 4, 4);
+        setError(decoder->error, "crc error at %zu, block crc was %x but table crc was %x", blockNum, crc, tableCrc);
+        return NULL;
+    }
+    if (block == decoder->data) {
+        decoder->dataBlockNum = blockNum;
+    } else {
+        decoder->blockNum = blockNum;
+    }
+    return block;
+}
+
+/**
+ * Read length bytes of the original image starting at any offset
+ *
+ * Returns the number of bytes read, which is only short at the end of the disc
+ */
+size_t osnisDecoderReadAt(struct OsnisDecoder *decoder, unsigned char *buffer, size_t length, uint64_t offset)
+{
+    struct DiscInfo *discInfo = decoder->discInfo;
+    size_t done = 0;
+    while (done < length) {
+        size_t blockNum = (offset + done) / discInfo->blockSize;
+        size_t start = (offset + done) % discInfo->blockSize;
+        size_t blockLength = getBlockLength(discInfo, blockNum);
+        const unsigned char *block;
+        if (start >= blockLength || (block = osnisDecodeBlock(decoder, blockNum)) == NULL) {
+            break;
+        }
+        size_t count = blockLength - start;
+        if (count > length - done) {
+            count = length - done;
+        }
+        memcpy(buffer + done, block + start, count);
+        done += count;
+    }
+    return done;
+}
+
+/**
+ * Read the next length bytes of the original image
+ */
+size_t osnisDecoderRead(struct OsnisDecoder *decoder, unsigned char *buffer, size_t length)
+{
+    size_t read = osnisDecoderReadAt(decoder, buffer, length, decoder->position);
+    decoder->position += read;
+    return read;
+}
+
+/**
+ * Free everything the decoder allocated, including its disc info
+ */
+void osnisDecoderFree(struct OsnisDecoder *decoder)
+{
+    freeDiscInfo(decoder->discInfo);
+    free(decoder->offsets);
+    free(decoder->manifest);
+    free(decoder->manifestPosition);
+    free(decoder->block);
+    free(decoder->data);
+    free(decoder->record);
+    memset(decoder, 0, sizeof(struct OsnisDecoder));
+}
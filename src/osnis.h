@@ -0,0 +1,167 @@
+#ifndef OSNIS_H
+#define OSNIS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "disc_info.h"
+#include "checkpoint.h"
+
+// Long enough for any error the encoder or decoder reports
+#define OSNIS_ERROR_SIZE 256
+
+/**
+ * Called with output as it is made, return false to stop
+ */
+typedef bool (*OsnisWrite)(void *context, const unsigned char *data, size_t length);
+
+/**
+ * Called to read length bytes at an offset of a shrunken image like pread,
+ * returns how many bytes were read
+ */
+typedef size_t (*OsnisRead)(void *context, unsigned char *buffer, size_t length, uint64_t offset);
+
+/**
+ * A push encoder, data is pushed in any sized chunks and the shrunken
+ * image comes out through the write callbacks
+ */
+struct OsnisEncoder
+{
+    struct DiscInfo *discInfo;
+    bool verify;
+    OsnisWrite writeTable;
+    OsnisWrite writeData;
+    void *context;
+    size_t blockSize;
+
+    // a block that came in over more than one push
+    unsigned char *block;
+    size_t filled;
+    unsigned char *record;
+
+    struct Checkpoint state;
+    uint64_t inputSize;
+    bool failed;
+
+    // set when the encoder made the disc info itself and frees it
+    bool ownsDiscInfo;
+
+    // why encoding failed, empty until it does
+    char error[OSNIS_ERROR_SIZE];
+};
+
+/**
+ * A pull decoder, the original image is read back from any offset
+ * of a shrunken image that is read through the read callback
+ */
+struct OsnisDecoder
+{
+    struct DiscInfo *discInfo;
+    OsnisRead read;
+    void *context;
+
+    // where the stored data for each block starts in the shrunken image
+    uint64_t *offsets;
+
+    // the last generated block, and the last stored data block kept
+    // apart so a repeat of it never has to be read again, along with the
+    // block numbers they were checked for or SIZE_MAX
+    unsigned char *block;
+    size_t blockNum;
+    unsigned char *data;
+    uint64_t dataOffset;
+    size_t dataBlockNum;
+    unsigned char *record;
+
+    // where the next osnisDecoderRead starts
+    uint64_t position;
+
+    // the blocks of the manifest in the order the recorded session read
+    // them, and where each block comes in that order or UINT32_MAX, so a
+    // reader can tell how far along the session is and decode ahead of it
+    uint32_t *manifest;
+    size_t manifestLength;
+    uint32_t *manifestPosition;
+
+    // why the last call failed, nothing is printed so the caller decides
+    // where it goes
+    char error[OSNIS_ERROR_SIZE];
+};
+
+/**
+ * Start encoding
+ *
+ * With no disc info the disc info is worked out from the start of the data
+ * using the given block size, 0 for the default.  A disc info from
+ * getDiscInfo can also be given, with its wii partitions set up first.
+ * Either way the table is built as the data goes by and is given to
+ * writeTable from osnisEncoderFinish, everything given to writeData
+ * goes after the table in the shrunken image.
+ *
+ * With verify the disc info has to come from profileImage, the table is
+ * written first and every block is checked against it as it is written.
+ *
+ * Either callback can be NULL.  The only memory used is allocated here,
+ * whole blocks in the pushed data are used where they are.  A disc info
+ * that is passed in stays the caller's, one the encoder works out itself
+ * is freed by osnisEncoderFree.  Nothing is printed, when a call returns
+ * false the reason is in error.
+ */
+bool osnisEncoderInit(struct OsnisEncoder *encoder, struct DiscInfo *discInfo, bool verify, size_t blockSize,
+        OsnisWrite writeTable, OsnisWrite writeData, void *context);
+
+/**
+ * Push the next length bytes of the original image
+ */
+bool osnisEncoderPush(struct OsnisEncoder *encoder, const unsigned char *data, size_t length);
+
+/**
+ * Encode whatever is left and write the table if it was built as the data went by
+ *
+ * The disc info stays around until osnisEncoderFree
+ */
+bool osnisEncoderFinish(struct OsnisEncoder *encoder);
+
+/**
+ * Free everything the encoder allocated, including the disc info if it
+ * made it, this is safe to call after a failed osnisEncoderInit
+ */
+void osnisEncoderFree(struct OsnisEncoder *encoder);
+
+/**
+ * Start decoding, this reads the table and the first block
+ *
+ * If the image has a manifest it is laid out in manifest and manifestPosition.
+ * The decoder owns its disc info, the common key stays the caller's and has
+ * to outlive the decoder.  Call osnisDecoderFree even if this fails.
+ */
+bool osnisDecoderInit(struct OsnisDecoder *decoder, OsnisRead read, void *context, unsigned char *commonKey);
+
+/**
+ * Decode a block of the original image
+ *
+ * Returns the block, getBlockLength bytes long, which stays valid
+ * until the next call or NULL if it could not be decoded.  Asking for
+ * the same block again hands back the one already decoded.
+ */
+const unsigned char * osnisDecodeBlock(struct OsnisDecoder *decoder, size_t blockNum);
+
+/**
+ * Read length bytes of the original image starting at any offset
+ *
+ * Returns the number of bytes read, which is only short at the end of the disc
+ */
+size_t osnisDecoderReadAt(struct OsnisDecoder *decoder, unsigned char *buffer, size_t length, uint64_t offset);
+
+/**
+ * Read the next length bytes of the original image
+ */
+size_t osnisDecoderRead(struct OsnisDecoder *decoder, unsigned char *buffer, size_t length);
+
+/**
+ * Free everything the decoder allocated, including its disc info but not
+ * the common key
+ */
+void osnisDecoderFree(struct OsnisDecoder *decoder);
+
+#endif
@@ -0,0 +1,602 @@
+#define _FILE_OFFSET_BITS 64
+#define _XOPEN_SOURCE 700
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "disc_info.h"
+#include "osnisd.h"
+#include "osnis.h"
+#include "wii.h"
+
+/**
+ * A decoded block in the cache, kept on a hash chain for lookups
+ * and on a list from most to least recently used for eviction
+ */
+struct CacheEntry
+{
+    uint32_t image;
+    size_t blockNum;
+    unsigned char *data;
+    size_t length;
+    struct CacheEntry *chain;
+    struct CacheEntry *newer;
+    struct CacheEntry *older;
+};
+
+/**
+ * One cache of decoded blocks shared by every client and image
+ */
+struct Cache
+{
+    struct CacheEntry **buckets;
+    size_t bucketCount;
+    struct CacheEntry *newest;
+    struct CacheEntry *oldest;
+    uint64_t size;
+    uint64_t maxSize;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t prefetched;
+};
+
+/**
+ * A connected client and its shared memory buffer
+ */
+struct Client
+{
+    int socket;
+    unsigned char *shared;
+
+    // the socket never blocks, so a request can come in pieces and a reply
+    // can go out in pieces without holding up the other clients
+    struct OsnisdRequest request;
+    size_t received;
+    struct OsnisdReply reply;
+    size_t sent;
+    bool replying;
+};
+
+/**
+ * An open shrunken image and the decoder that reads it
+ *
+ * With a manifest, demand is how far along the manifest clients have read
+ * and prefetch is the next manifest block to decode ahead of them
+ */
+struct Image
+{
+    char *path;
+    int fd;
+    struct OsnisDecoder decoder;
+    size_t demand;
+    size_t prefetch;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static struct Image **images = NULL;
+static size_t imageCount = 0;
+
+static void stop(int sig)
+{
+    running = 0;
+}
+
+/**
+ * Read part of a shrunken image for its decoder
+ */
+static size_t readImageFile(void *context, unsigned char *buffer, size_t length, uint64_t offset)
+{
+    struct Image *image = context;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t read = pread(image->fd, buffer + done, length - done, offset + done);
+        if (read <= 0) {
+            break;
+        }
+        done += read;
+    }
+    return done;
+}
+
+static size_t cacheBucket(struct Cache *cache, uint32_t image, size_t blockNum)
+{
+    return ((uint64_t) image * 0x9E3779B1u + blockNum) % cache->bucketCount;
+}
+
+/**
+ * Take an entry off the recently used list
+ */
+static void cacheUnlink(struct Cache *cache, struct CacheEntry *entry)
+{
+    if (entry->newer != NULL) entry->newer->older = entry->older; else cache->newest = entry->older;
+    if (entry->older != NULL) entry->older->newer = entry->newer; else cache->oldest = entry->newer;
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+/**
+ * Put an entry at the front of the recently used list
+ */
+static void cachePushNewest(struct Cache *cache, struct CacheEntry *entry)
+{
+    entry->older = cache->newest;
+    entry->newer = NULL;
+    if (cache->newest != NULL) cache->newest->newer = entry; else cache->oldest = entry;
+    cache->newest = entry;
+}
+
+/**
+ * Drop the least recently used blocks until there is room for length more bytes
+ */
+static void cacheEvict(struct Cache *cache, size_t length)
+{
+    while (cache->size + length > cache->maxSize && cache->oldest != NULL) {
+        struct CacheEntry *entry = cache->oldest;
+        cacheUnlink(cache, entry);
+
+        struct CacheEntry **link = &cache->buckets[cacheBucket(cache, entry->image, entry->blockNum)];
+        while (*link != entry) {
+            link = &(*link)->chain;
+        }
+        *link = entry->chain;
+
+        cache->size -= entry->length;
+        free(entry->data);
+        free(entry);
+    }
+}
+
+/**
+ * Find a decoded block in the cache and make it the most recently used
+ */
+static struct CacheEntry * cacheFind(struct Cache *cache, uint32_t image, size_t blockNum)
+{
+    size_t bucket = cacheBucket(cache, image, blockNum);
+    for (struct CacheEntry *entry = cache->buckets[bucket]; entry != NULL; entry = entry->chain) {
+        if (entry->image == image && entry->blockNum == blockNum) {
+            cacheUnlink(cache, entry);
+            cachePushNewest(cache, entry);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Decode a block into the cache, making room for it first so the entry
+ * handed back is never the one evicted
+ */
+static struct CacheEntry * cacheAdd(struct Cache *cache, uint32_t image, size_t blockNum)
+{
+    size_t bucket = cacheBucket(cache, image, blockNum);
+    struct OsnisDecoder *decoder = &images[image]->decoder;
+    const unsigned char *block = osnisDecodeBlock(decoder, blockNum);
+    if (block == NULL) {
+        fprintf(stderr, "OSNISD ERROR: %s: %s\n", images[image]->path, decoder->error);
+        return NULL;
+    }
+    struct CacheEntry *entry = calloc(1, sizeof(struct CacheEntry));
+    entry->image = image;
+    entry->blockNum = blockNum;
+    entry->length = getBlockLength(decoder->discInfo, blockNum);
+    entry->data = malloc(entry->length);
+    memcpy(entry->data, block, entry->length);
+
+    cacheEvict(cache, entry->length);
+    entry->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    cachePushNewest(cache, entry);
+    cache->size += entry->length;
+    return entry;
+}
+
+/**
+ * Get a decoded block from the cache, decoding it if it is not there
+ */
+static struct CacheEntry * cacheGet(struct Cache *cache, uint32_t image, size_t blockNum)
+{
+    struct CacheEntry *entry = cacheFind(cache, image, blockNum);
+    if (entry != NULL) {
+        cache->hits++;
+        return entry;
+    }
+    cache->misses++;
+    return cacheAdd(cache, image, blockNum);
+}
+
+/**
+ * How many manifest blocks to decode ahead of demand, half the cache
+ * so prefetched blocks do not push out the ones being read, but always
+ * at least the next one
+ */
+static size_t prefetchWindow(struct Cache *cache, uint32_t image)
+{
+    size_t window = cache->maxSize / images[image]->decoder.discInfo->blockSize / 2;
+    return (window > 0) ? window : 1;
+}
+
+/**
+ * Decode the next manifest block of the first image that has one to do
+ *
+ * Returns false when every image is as far ahead of its clients as it can be
+ */
+static bool prefetchBlock(struct Cache *cache)
+{
+    for (uint32_t image = 0; image < imageCount; image++) {
+        struct Image *open = images[image];
+        if (open->prefetch >= open->decoder.manifestLength || open->prefetch - open->demand >= prefetchWindow(cache, image)) {
+            continue;
+        }
+        size_t blockNum = open->decoder.manifest[open->prefetch++];
+        if (cacheFind(cache, image, blockNum) == NULL && cacheAdd(cache, image, blockNum) != NULL) {
+            cache->prefetched++;
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Keep track of how far along the manifest clients have read, a read
+ * further along than the prefetch means the session skipped ahead
+ */
+static void trackDemand(uint32_t image, size_t blockNum)
+{
+    struct Image *open = images[image];
+    if (open->decoder.manifestPosition == NULL || open->decoder.manifestPosition[blockNum] == UINT32_MAX) {
+        return;
+    }
+    size_t position = open->decoder.manifestPosition[blockNum];
+    if (position >= open->demand) {
+        open->demand = position + 1;
+    }
+    if (open->prefetch < open->demand) {
+        open->prefetch = open->demand;
+    }
+}
+
+/**
+ * Open an image once no matter how many clients ask for it
+ */
+static int openImage(const char *path, unsigned char *commonKey, uint64_t *size)
+{
+    char resolved[PATH_MAX];
+    if (realpath(path, resolved) == NULL) {
+        fprintf(stderr, "OSNISD ERROR: could not find %s\n", path);
+        return -1;
+    }
+
+    for (size_t i = 0; i < imageCount; i++) {
+        if (strcmp(images[i]->path, resolved) == 0) {
+            *size = getDiscSize(images[i]->decoder.discInfo);
+            return i;
+        }
+    }
+
+    struct Image *image = calloc(1, sizeof(struct Image));
+    image->fd = open(resolved, O_RDONLY);
+    if (image->fd < 0 || !osnisDecoderInit(&image->decoder, readImageFile, image, commonKey)) {
+        fprintf(stderr, "OSNISD ERROR: could not open %s: %s\n", resolved,
+            (image->fd < 0) ? strerror(errno) : image->decoder.error);
+        if (image->fd >= 0) close(image->fd);
+        osnisDecoderFree(&image->decoder);
+        free(image);
+        return -1;
+    }
+    image->path = strdup(resolved);
+    images = realloc(images, (imageCount + 1) * sizeof(struct Image *));
+    images[imageCount] = image;
+    fprintf(stderr, "Opened %s\n", resolved);
+    if (image->decoder.manifestLength > 0) {
+        fprintf(stderr, "Prefetching %zu blocks from its manifest\n", image->decoder.manifestLength);
+    }
+
+    *size = getDiscSize(image->decoder.discInfo);
+    return imageCount++;
+}
+
+/**
+ * Copy a range of an image out of the cache into the buffer, the range
+ * has to start on the disc and is cut short at the end of it
+ */
+static uint64_t readImage(struct Cache *cache, uint32_t image, uint64_t offset, uint64_t length, unsigned char *buffer)
+{
+    uint64_t discSize = getDiscSize(images[image]->decoder.discInfo);
+    if (length > discSize - offset) {
+        length = discSize - offset;
+    }
+
+    uint64_t done = 0;
+    while (done < length) {
+        size_t blockSize = images[image]->decoder.discInfo->blockSize;
+        size_t blockNum = (offset + done) / blockSize;
+        size_t start = (offset + done) % blockSize;
+        trackDemand(image, blockNum);
+        struct CacheEntry *entry = cacheGet(cache, image, blockNum);
+        if (entry == NULL || start >= entry->length) {
+            break;
+        }
+        size_t count = entry->length - start;
+        if (count > length - done) {
+            count = length - done;
+        }
+        memcpy(buffer + done, entry->data + start, count);
+        done += count;
+    }
+    return done;
+}
+
+/**
+ * Give a new client its own shared memory buffer by passing the file
+ * descriptor over the socket, the name is removed as soon as both
+ * sides have it mapped so nothing is left behind
+ */
+static bool acceptClient(int listener, struct Client *client)
+{
+    static unsigned int sharedCount = 0;
+
+    client->socket = accept(listener, NULL, NULL);
+    if (client->socket < 0) {
+        return false;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/osnisd.%d.%u", (int) getpid(), sharedCount++);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "OSNISD ERROR: could not create shared memory\n");
+        close(client->socket);
+        return false;
+    }
+    shm_unlink(name);
+    if (ftruncate(fd, OSNISD_SHARED_SIZE) != 0
+            || (client->shared = mmap(NULL, OSNISD_SHARED_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "OSNISD ERROR: could not map shared memory\n");
+        close(fd);
+        close(client->socket);
+        return false;
+    }
+
+    struct OsnisdReply reply = {0, 0, OSNISD_SHARED_SIZE};
+    struct iovec iov = {&reply, sizeof(reply)};
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    bool sent = sendmsg(client->socket, &message, 0) == sizeof(reply);
+    close(fd);
+    if (!sent || fcntl(client->socket, F_SETFL, fcntl(client->socket, F_GETFL) | O_NONBLOCK) != 0) {
+        munmap(client->shared, OSNISD_SHARED_SIZE);
+        close(client->socket);
+        return false;
+    }
+    client->received = 0;
+    client->sent = 0;
+    client->replying = false;
+    return true;
+}
+
+/**
+ * Work out the reply to a whole request
+ */
+static struct OsnisdReply answerRequest(struct Cache *cache, struct Client *client, unsigned char *commonKey)
+{
+    struct OsnisdRequest *request = &client->request;
+    struct OsnisdReply reply = {-1, 0, 0};
+    if (request->op == OSNISD_OPEN) {
+        request->path[OSNISD_PATH_SIZE - 1] = 0;
+        int image = openImage(request->path, commonKey, &reply.length);
+        if (image >= 0) {
+            reply.status = 0;
+            reply.image = image;
+        }
+    } else if (request->op == OSNISD_READ && request->image < imageCount && request->length <= OSNISD_SHARED_SIZE
+            && request->offset < getDiscSize(images[request->image]->decoder.discInfo)) {
+        // a read that starts past the end of the disc fails before it
+        // gets near the manifest or the cache
+        reply.status = 0;
+        reply.image = request->image;
+        reply.length = readImage(cache, request->image, request->offset, request->length, client->shared);
+    }
+    return reply;
+}
+
+/**
+ * Send as much of the reply as the socket takes, false when the client has gone away
+ */
+static bool sendReply(struct Client *client)
+{
+    while (client->sent < sizeof(client->reply)) {
+        ssize_t sent = send(client->socket, (unsigned char *) &client->reply + client->sent,
+            sizeof(client->reply) - client->sent, 0);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        client->sent += sent;
+    }
+    client->replying = false;
+    return true;
+}
+
+/**
+ * Take whatever part of a request has come in and answer it once it is
+ * all there, false when the client has gone away
+ */
+static bool receiveRequest(struct Cache *cache, struct Client *client, unsigned char *commonKey)
+{
+    ssize_t received = recv(client->socket, (unsigned char *) &client->request + client->received,
+        sizeof(client->request) - client->received, 0);
+    if (received == 0) {
+        return false;
+    }
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    client->received += received;
+    if (client->received < sizeof(client->request)) {
+        return true;
+    }
+
+    client->received = 0;
+    client->reply = answerRequest(cache, client, commonKey);
+    client->sent = 0;
+    client->replying = true;
+    return sendReply(client);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socketPath = OSNISD_SOCKET;
+    uint64_t cacheSize = OSNISD_CACHE_SIZE;
+    unsigned char key[16];
+    unsigned char *commonKey = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:m:S:h")) != -1) {
+        switch (opt) {
+            case 'k':
+                if (!readCommonKey(optarg, key)) {
+                    return 1;
+                }
+                commonKey = key;
+                break;
+            case 'm':
+                cacheSize = strtoull(optarg, NULL, 0) << 20;
+                break;
+            case 'S':
+                socketPath = optarg;
+                break;
+            case 'h':
+            default:
+                fprintf(stderr, "Usage: %s [-S socket] [-m cacheMegabytes] [-k keyFile]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // every block handed to a client has to fit in the cache on its own
+    if (cacheSize < MAX_BLOCK_SIZE) {
+        fprintf(stderr, "OSNISD ERROR: the cache has to hold at least one 0x%zx byte block\n", MAX_BLOCK_SIZE);
+        return 1;
+    }
+
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "OSNISD ERROR: socket path is too long\n");
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        fprintf(stderr, "OSNISD ERROR: could not listen on %s\n", socketPath);
+        return 1;
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // enough buckets for a cache full of the smallest blocks
+    struct Cache cache = {0};
+    cache.maxSize = cacheSize;
+    cache.bucketCount = cacheSize / MIN_BLOCK_SIZE + 1;
+    cache.buckets = calloc(cache.bucketCount, sizeof(struct CacheEntry *));
+
+    // the first poll entry is the listening socket, the rest are clients
+    struct pollfd *fds = calloc(1, sizeof(struct pollfd));
+    struct Client *clients = calloc(1, sizeof(struct Client));
+    size_t clientCount = 0;
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+
+    fprintf(stderr, "Listening on %s with a 0x%llx byte cache\n", socketPath, (unsigned long long) cacheSize);
+    // while there are manifest blocks to prefetch only check on
+    // the clients between blocks instead of waiting for them
+    bool prefetching = false;
+    while (running) {
+        int ready = poll(fds, clientCount + 1, prefetching ? 0 : -1);
+        if (ready == 0) {
+            prefetching = prefetchBlock(&cache);
+            continue;
+        }
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (size_t i = clientCount; i > 0; i--) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            // a client only gets its next request read once its reply has gone
+            struct Client *client = &clients[i - 1];
+            bool alive = client->replying
+                ? (fds[i].revents & POLLOUT) && sendReply(client)
+                : (fds[i].revents & POLLIN) && receiveRequest(&cache, client, commonKey);
+            if (alive) {
+                fds[i].events = client->replying ? POLLOUT : POLLIN;
+                continue;
+            }
+
+            // the client has gone away, move the last one into its place
+            munmap(clients[i - 1].shared, OSNISD_SHARED_SIZE);
+            close(clients[i - 1].socket);
+            clients[i - 1] = clients[clientCount - 1];
+            fds[i] = fds[clientCount];
+            clientCount--;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            struct Client client;
+            if (acceptClient(listener, &client)) {
+                clients = realloc(clients, (clientCount + 1) * sizeof(struct Client));
+                fds = realloc(fds, (clientCount + 2) * sizeof(struct pollfd));
+                clients[clientCount] = client;
+                fds[clientCount + 1].fd = client.socket;
+                fds[clientCount + 1].events = POLLIN;
+                fds[clientCount + 1].revents = 0;
+                clientCount++;
+            }
+        }
+
+        // reads can move demand along so there may be more to prefetch
+        prefetching = true;
+    }
+
+    fprintf(stderr, "Cache hits: %llu misses: %llu prefetched: %llu\n", (unsigned long long) cache.hits,
+        (unsigned long long) cache.misses, (unsigned long long) cache.prefetched);
+    close(listener);
+    unlink(socketPath);
+    return 0;
+}
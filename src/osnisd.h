@@ -0,0 +1,51 @@
+#ifndef OSNISD_H
+#define OSNISD_H
+
+#include <stdint.h>
+
+// Where the daemon listens if no socket is given
+static const char OSNISD_SOCKET[] = "/tmp/osnisd.sock";
+
+// Every client gets a shared memory buffer of this size for block data,
+// big enough for a few of the biggest blocks
+#define OSNISD_SHARED_SIZE 0x400000
+
+// The longest image path a client can ask for
+#define OSNISD_PATH_SIZE 1024
+
+// Default size of the decoded block cache
+static const uint64_t OSNISD_CACHE_SIZE = 0x10000000;
+
+enum OsnisdOp
+{
+    OSNISD_OPEN = 1,
+    OSNISD_READ = 2
+};
+
+/**
+ * A request from a client, the path is only used by OSNISD_OPEN
+ */
+struct OsnisdRequest
+{
+    uint32_t op;
+    uint32_t image;
+    uint64_t offset;
+    uint64_t length;
+    char path[OSNISD_PATH_SIZE];
+};
+
+/**
+ * The reply to a request
+ *
+ * For OSNISD_OPEN the image is the handle to read with and the length is
+ * the size of the original image, for OSNISD_READ the length is how many
+ * bytes were copied to the start of the shared memory buffer
+ */
+struct OsnisdReply
+{
+    int32_t status;
+    uint32_t image;
+    uint64_t length;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#define _FILE_OFFSET_BITS 64
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "osnisd.h"
+#include "osnisd_client.h"
+
+/**
+ * Connect to the daemon at the given socket, NULL for the default
+ *
+ * The daemon answers a new connection with the file descriptor
+ * of the shared memory buffer this client reads from
+ */
+struct OsnisdClient * osnisdConnect(const char *socketPath)
+{
+    if (socketPath == NULL) {
+        socketPath = OSNISD_SOCKET;
+    }
+
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        return NULL;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0 || connect(s, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        if (s >= 0) close(s);
+        return NULL;
+    }
+
+    struct OsnisdReply reply;
+    struct iovec iov = {&reply, sizeof(reply)};
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *cmsg;
+    if (recvmsg(s, &message, MSG_WAITALL) != sizeof(reply) || reply.status != 0
+            || (cmsg = CMSG_FIRSTHDR(&message)) == NULL || cmsg->cmsg_type != SCM_RIGHTS) {
+        close(s);
+        return NULL;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+    unsigned char *shared = mmap(NULL, OSNISD_SHARED_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        close(s);
+        return NULL;
+    }
+
+    struct OsnisdClient *client = calloc(1, sizeof(struct OsnisdClient));
+    client->socket = s;
+    client->shared = shared;
+    return client;
+}
+
+/**
+ * Send a request and wait for its reply
+ */
+static int request(struct OsnisdClient *client, struct OsnisdRequest *request, struct OsnisdReply *reply)
+{
+    if (send(client->socket, request, sizeof(*request), 0) != sizeof(*request)
+            || recv(client->socket, reply, sizeof(*reply), MSG_WAITALL) != sizeof(*reply)) {
+        return -1;
+    }
+    return reply->status;
+}
+
+/**
+ * Ask the daemon to open a shrunken image
+ *
+ * Returns the handle to read the image with or -1, the size
+ * of the original image is written to size
+ */
+int osnisdOpen(struct OsnisdClient *client, const char *file, uint64_t *size)
+{
+    struct OsnisdRequest req = {0};
+    struct OsnisdReply reply;
+    req.op = OSNISD_OPEN;
+    if (strlen(file) >= OSNISD_PATH_SIZE) {
+        return -1;
+    }
+    strcpy(req.path, file);
+    if (request(client, &req, &reply) != 0) {
+        return -1;
+    }
+    if (size != NULL) {
+        *size = reply.length;
+    }
+    return reply.image;
+}
+
+/**
+ * Read up to OSNISD_SHARED_SIZE bytes of the original image into the shared
+ * memory buffer without copying them again, the data stays valid until
+ * the next request
+ *
+ * Returns the number of bytes read or -1
+ */
+int64_t osnisdReadShared(struct OsnisdClient *client, int image, uint64_t offset, size_t length)
+{
+    struct OsnisdRequest req = {0};
+    struct OsnisdReply reply;
+    req.op = OSNISD_READ;
+    req.image = image;
+    req.offset = offset;
+    req.length = (length < OSNISD_SHARED_SIZE) ? length : OSNISD_SHARED_SIZE;
+    if (request(client, &req, &reply) != 0) {
+        return -1;
+    }
+    return reply.length;
+}
+
+/**
+ * Read any number of bytes of the original image into the buffer
+ *
+ * Returns the number of bytes read or -1
+ */
+int64_t osnisdRead(struct OsnisdClient *client, int image, uint64_t offset, unsigned char *buffer, size_t length)
+{
+    size_t done = 0;
+    while (done < length) {
+        int64_t read = osnisdReadShared(client, image, offset + done, length - done);
+        if (read < 0) {
+            return -1;
+        }
+        if (read == 0) {
+            break;
+        }
+        memcpy(buffer + done, client->shared, read);
+        done += read;
+    }
+    return done;
+}
+
+/**
+ * Close the connection
+ */
+void osnisdDisconnect(struct OsnisdClient *client)
+{
+    munmap(client->shared, OSNISD_SHARED_SIZE);
+    close(client->socket);
+    free(client);
+}
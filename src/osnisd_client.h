@@ -0,0 +1,51 @@
+#ifndef OSNISD_CLIENT_H
+#define OSNISD_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A connection to osnisd and the shared memory buffer it reads into
+ */
+struct OsnisdClient
+{
+    int socket;
+    unsigned char *shared;
+};
+
+/**
+ * Connect to the daemon at the given socket, NULL for the default
+ */
+struct OsnisdClient * osnisdConnect(const char *socketPath);
+
+/**
+ * Ask the daemon to open a shrunken image
+ *
+ * Returns the handle to read the image with or -1, the size
+ * of the original image is written to size
+ */
+int osnisdOpen(struct OsnisdClient *client, const char *file, uint64_t *size);
+
+/**
+ * Read up to OSNISD_SHARED_SIZE bytes of the original image into the shared
+ * memory buffer without copying them again, the data stays valid until
+ * the next request
+ *
+ * Returns the number of bytes read or -1
+ */
+int64_t osnisdReadShared(struct OsnisdClient *client, int image, uint64_t offset, size_t length);
+
+/**
+ * Read any number of bytes of the original image into the buffer
+ *
+ * Returns the number of bytes read or -1
+ */
+int64_t osnisdRead(struct OsnisdClient *client, int image, uint64_t offset, unsigned char *buffer, size_t length);
+
+/**
+ * Close the connection
+ */
+void osnisdDisconnect(struct OsnisdClient *client);
+
+#endif
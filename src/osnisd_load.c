@@ -0,0 +1,216 @@
+#define _FILE_OFFSET_BITS 64
+#define _XOPEN_SOURCE 700
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "osnisd.h"
+#include "osnisd_client.h"
+
+/**
+ * The reads of a trace file, in the same format osnis -m takes
+ */
+struct Trace {
+    uint64_t *offsets;
+    size_t *lengths;
+    int count;
+};
+
+/**
+ * Read the offset and length of every read in a trace, skipping any
+ * other line and any read longer than the shared buffer
+ */
+static bool readTrace(const char *file, struct Trace *trace)
+{
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        fprintf(stderr, "LOAD ERROR: could not open %s\n", file);
+        return false;
+    }
+
+    int capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *end;
+        char *lengthStart;
+        uint64_t offset = strtoull(line, &lengthStart, 0);
+        uint64_t length = strtoull(lengthStart, &end, 0);
+        if (lengthStart == line || end == lengthStart || length == 0 || length > OSNISD_SHARED_SIZE) {
+            continue;
+        }
+        if (trace->count == capacity) {
+            capacity = (capacity == 0) ? 64 : capacity * 2;
+            trace->offsets = realloc(trace->offsets, capacity * sizeof(uint64_t));
+            trace->lengths = realloc(trace->lengths, capacity * sizeof(size_t));
+        }
+        trace->offsets[trace->count] = offset;
+        trace->lengths[trace->count] = length;
+        trace->count++;
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * Do random reads of the image through the daemon, or the reads of a
+ * trace in order, checking them against the original image if there is one
+ *
+ * Returns the number of reads that went wrong
+ */
+static int runClient(const char *socketPath, const char *file, const char *original, const struct Trace *trace, int reads, size_t length, unsigned int seed)
+{
+    struct OsnisdClient *client = osnisdConnect(socketPath);
+    if (client == NULL) {
+        fprintf(stderr, "LOAD ERROR: could not connect to %s\n", socketPath != NULL ? socketPath : OSNISD_SOCKET);
+        return reads;
+    }
+
+    uint64_t size;
+    int image = osnisdOpen(client, file, &size);
+    if (image < 0) {
+        fprintf(stderr, "LOAD ERROR: the daemon could not open %s\n", file);
+        osnisdDisconnect(client);
+        return reads;
+    }
+
+    FILE *f = (original != NULL) ? fopen(original, "rb") : NULL;
+    unsigned char *expected = malloc(OSNISD_SHARED_SIZE);
+
+    // a session does something with each read before the next one, which
+    // is when the daemon gets to prefetch
+    struct timespec pause = {0, 1000000};
+
+    int errors = 0;
+    srand(seed);
+    for (int i = 0; i < reads; i++) {
+        uint64_t offset;
+        if (trace != NULL) {
+            offset = trace->offsets[i];
+            length = trace->lengths[i];
+            nanosleep(&pause, NULL);
+        } else {
+            // reads are lined up on 0x800 byte sectors like a disc drive would do
+            offset = ((((uint64_t) rand() << 16) ^ rand()) % (size / 0x800)) * 0x800;
+        }
+        int64_t read = osnisdReadShared(client, image, offset, length);
+        if (read < 0) {
+            errors++;
+            continue;
+        }
+        if (f != NULL) {
+            fseeko(f, offset, SEEK_SET);
+            size_t expectedLength = fread(expected, 1, length, f);
+            if (expectedLength != (size_t) read || memcmp(expected, client->shared, read) != 0) {
+                fprintf(stderr, "LOAD ERROR: read of 0x%zx bytes at 0x%llx did not match\n", length, (unsigned long long) offset);
+                errors++;
+            }
+        }
+    }
+
+    if (f != NULL) fclose(f);
+    free(expected);
+    osnisdDisconnect(client);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socketPath = NULL;
+    const char *file = NULL;
+    const char *original = NULL;
+    const char *traceFile = NULL;
+    int clients = 4;
+    int reads = 1000;
+    size_t length = 0x8000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:i:l:n:S:t:v:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                clients = atoi(optarg);
+                break;
+            case 'i':
+                file = optarg;
+                break;
+            case 'l':
+                length = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                reads = atoi(optarg);
+                break;
+            case 'S':
+                socketPath = optarg;
+                break;
+            case 't':
+                traceFile = optarg;
+                break;
+            case 'v':
+                original = optarg;
+                break;
+            case 'h':
+            default:
+                fprintf(stderr, "Usage: %s -i image.osnis [-S socket] [-c clients] [-n reads] [-l length] [-t trace] [-v original.iso]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (file == NULL || clients < 1 || length == 0 || length > OSNISD_SHARED_SIZE) {
+        fprintf(stderr, "Usage: %s -i image.osnis [-S socket] [-c clients] [-n reads] [-l length] [-t trace] [-v original.iso]\n", argv[0]);
+        return 1;
+    }
+
+    // replaying a trace reads it all once instead of doing random reads
+    struct Trace trace = {0};
+    if (traceFile != NULL) {
+        if (!readTrace(traceFile, &trace)) {
+            return 1;
+        }
+        reads = trace.count;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // every client is its own process so they only share what the daemon shares
+    for (int i = 0; i < clients; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(runClient(socketPath, file, original, (traceFile != NULL) ? &trace : NULL, reads, length, i + 1) > 0);
+        }
+        if (pid < 0) {
+            fprintf(stderr, "LOAD ERROR: could not start client %d\n", i);
+            clients = i;
+            break;
+        }
+    }
+
+    int failed = 0;
+    int status;
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double total = (double) clients * reads;
+    double bytes = total * length;
+    if (traceFile != NULL) {
+        bytes = 0;
+        for (int i = 0; i < trace.count; i++) bytes += (double) clients * trace.lengths[i];
+        fprintf(stderr, "%d clients, %.0f reads from %s in %.2fs\n", clients, total, traceFile, seconds);
+    } else {
+        fprintf(stderr, "%d clients, %.0f reads of 0x%zx bytes in %.2fs\n", clients, total, length, seconds);
+    }
+    fprintf(stderr, "%.0f reads/s, %.1f MB/s\n", total / seconds, bytes / seconds / 1e6);
+    if (failed > 0) {
+        fprintf(stderr, "%d clients had errors\n", failed);
+    }
+    free(trace.offsets);
+    free(trace.lengths);
+    return failed > 0;
+}
@@ -0,0 +1,267 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sha1.h"
+
+// Use SSE2 to hash four buffers at once when the compiler can build it,
+// it is picked at runtime if the cpu has it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+ * Run one 64 byte chunk through the hash state
+ */
+static void sha1Chunk(uint32_t state[5], const unsigned char chunk[64])
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) chunk[i * 4] << 24) | ((uint32_t) chunk[i * 4 + 1] << 16)
+            | ((uint32_t) chunk[i * 4 + 2] << 8) | (uint32_t) chunk[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = ROTL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        uint32_t temp = ROTL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROTL(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+/**
+ * Pad the end of a buffer with a 1 bit, zeros and the length in bits
+ *
+ * Returns how many bytes of last, 64 or 128, are left to hash
+ */
+static size_t sha1Pad(const unsigned char *buf, size_t len, unsigned char last[128])
+{
+    size_t rest = len % 64;
+    memset(last, 0, 128);
+    memcpy(last, buf + len - rest, rest);
+    last[rest] = 0x80;
+    size_t lastLength = (rest < 56) ? 64 : 128;
+    uint64_t bits = (uint64_t) len * 8;
+    for (int j = 0; j < 8; j++) {
+        last[lastLength - 1 - j] = (unsigned char)(bits >> (j * 8));
+    }
+    return lastLength;
+}
+
+/**
+ * Write the hash state out big endian
+ */
+static void sha1Output(const uint32_t state[5], unsigned char hash[20])
+{
+    for (int j = 0; j < 5; j++) {
+        hash[j * 4] = (unsigned char)(state[j] >> 24);
+        hash[j * 4 + 1] = (unsigned char)(state[j] >> 16);
+        hash[j * 4 + 2] = (unsigned char)(state[j] >> 8);
+        hash[j * 4 + 3] = (unsigned char)(state[j]);
+    }
+}
+
+/**
+ * Calculate the 20 byte SHA-1 hash of the given buffer and length
+ */
+void sha1(const unsigned char *buf, size_t len, unsigned char hash[20])
+{
+    uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        sha1Chunk(state, buf + i);
+    }
+
+    unsigned char last[128];
+    size_t lastLength = sha1Pad(buf, len, last);
+    sha1Chunk(state, last);
+    if (lastLength == 128) {
+        sha1Chunk(state, last + 64);
+    }
+    sha1Output(state, hash);
+}
+
+#ifdef HAVE_SSE2
+
+static bool sse2Supported = false;
+
+/**
+ * Check for SSE2 before main so there is nothing to race on later,
+ * setting OSNIS_NO_SIMD in the environment forces the one at a time path
+ * so it can be tested
+ */
+__attribute__((constructor))
+static void detectSse2(void)
+{
+    __builtin_cpu_init();
+    sse2Supported = __builtin_cpu_supports("sse2") && getenv("OSNIS_NO_SIMD") == NULL;
+}
+
+#define ROTL4(x, n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+
+/**
+ * Load big endian word i of a chunk from each of the four lanes
+ */
+static uint32_t loadWord(const unsigned char *chunk, int i)
+{
+    return ((uint32_t) chunk[i * 4] << 24) | ((uint32_t) chunk[i * 4 + 1] << 16)
+        | ((uint32_t) chunk[i * 4 + 2] << 8) | (uint32_t) chunk[i * 4 + 3];
+}
+
+/**
+ * Run one 64 byte chunk of each of four lanes through their hash states,
+ * every 32 bit part of the registers is a different lane
+ */
+__attribute__((target("sse2")))
+static void sha1Chunk4(__m128i state[5], const unsigned char *const chunks[4])
+{
+    __m128i w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = _mm_set_epi32((int) loadWord(chunks[3], i), (int) loadWord(chunks[2], i),
+            (int) loadWord(chunks[1], i), (int) loadWord(chunks[0], i));
+    }
+    for (int i = 16; i < 80; i++) {
+        __m128i x = _mm_xor_si128(_mm_xor_si128(w[i - 3], w[i - 8]), _mm_xor_si128(w[i - 14], w[i - 16]));
+        w[i] = ROTL4(x, 1);
+    }
+
+    __m128i a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        __m128i f, k;
+        if (i < 20) {
+            f = _mm_or_si128(_mm_and_si128(b, c), _mm_andnot_si128(b, d));
+            k = _mm_set1_epi32(0x5a827999);
+        } else if (i < 40) {
+            f = _mm_xor_si128(_mm_xor_si128(b, c), d);
+            k = _mm_set1_epi32(0x6ed9eba1);
+        } else if (i < 60) {
+            f = _mm_or_si128(_mm_and_si128(b, c), _mm_and_si128(d, _mm_or_si128(b, c)));
+            k = _mm_set1_epi32((int) 0x8f1bbcdc);
+        } else {
+            f = _mm_xor_si128(_mm_xor_si128(b, c), d);
+            k = _mm_set1_epi32((int) 0xca62c1d6);
+        }
+        __m128i temp = _mm_add_epi32(_mm_add_epi32(ROTL4(a, 5), f), _mm_add_epi32(_mm_add_epi32(e, k), w[i]));
+        e = d;
+        d = c;
+        c = ROTL4(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] = _mm_add_epi32(state[0], a);
+    state[1] = _mm_add_epi32(state[1], b);
+    state[2] = _mm_add_epi32(state[2], c);
+    state[3] = _mm_add_epi32(state[3], d);
+    state[4] = _mm_add_epi32(state[4], e);
+}
+
+/**
+ * Hash four buffers of the same length at once
+ */
+__attribute__((target("sse2")))
+static void sha1Four(const unsigned char *const bufs[4], size_t len, unsigned char *const hashes[4])
+{
+    static const uint32_t init[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    __m128i state[5];
+    for (int j = 0; j < 5; j++) {
+        state[j] = _mm_set1_epi32((int) init[j]);
+    }
+
+    const unsigned char *chunks[4];
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        for (int lane = 0; lane < 4; lane++) {
+            chunks[lane] = bufs[lane] + i;
+        }
+        sha1Chunk4(state, chunks);
+    }
+
+    // the buffers are the same length so they all need the same number of padding chunks
+    unsigned char last[4][128];
+    size_t lastLength = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        lastLength = sha1Pad(bufs[lane], len, last[lane]);
+        chunks[lane] = last[lane];
+    }
+    sha1Chunk4(state, chunks);
+    if (lastLength == 128) {
+        for (int lane = 0; lane < 4; lane++) {
+            chunks[lane] = last[lane] + 64;
+        }
+        sha1Chunk4(state, chunks);
+    }
+
+    uint32_t words[5][4];
+    for (int j = 0; j < 5; j++) {
+        _mm_storeu_si128((__m128i *) words[j], state[j]);
+    }
+    for (int lane = 0; lane < 4; lane++) {
+        uint32_t laneState[5] = {words[0][lane], words[1][lane], words[2][lane], words[3][lane], words[4][lane]};
+        sha1Output(laneState, hashes[lane]);
+    }
+}
+
+#endif
+
+/**
+ * Calculate the SHA-1 hashes of count separate buffers that are all len bytes
+ * long.  The buffers do not depend on each other so with SSE2 four of them
+ * are hashed at once
+ */
+void sha1Lanes(const unsigned char *const bufs[], size_t count, size_t len, unsigned char *const hashes[])
+{
+    size_t lane = 0;
+#ifdef HAVE_SSE2
+    if (sse2Supported) {
+        for (; lane + 4 <= count; lane += 4) {
+            sha1Four(bufs + lane, len, hashes + lane);
+        }
+
+        // the last few share a pass with copies of the last buffer whose hashes are thrown away
+        if (lane < count) {
+            const unsigned char *tailBufs[4];
+            unsigned char spare[4][20];
+            unsigned char *tailHashes[4];
+            for (int i = 0; i < 4; i++) {
+                bool real = lane + i < count;
+                tailBufs[i] = bufs[real ? lane + i : count - 1];
+                tailHashes[i] = real ? hashes[lane + i] : spare[i];
+            }
+            sha1Four(tailBufs, len, tailHashes);
+            lane = count;
+        }
+    }
+#endif
+    for (; lane < count; lane++) {
+        sha1(bufs[lane], len, hashes[lane]);
+    }
+}
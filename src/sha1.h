@@ -0,0 +1,18 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stddef.h>
+
+/**
+ * Calculate the 20 byte SHA-1 hash of the given buffer and length
+ */
+void sha1(const unsigned char *buf, size_t len, unsigned char hash[20]);
+
+/**
+ * Calculate the SHA-1 hashes of count separate buffers that are all len bytes
+ * long.  The buffers do not depend on each other so with SSE2 four of them
+ * are hashed at once
+ */
+void sha1Lanes(const unsigned char *const bufs[], size_t count, size_t len, unsigned char *const hashes[]);
+
+#endif
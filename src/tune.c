@@ -0,0 +1,163 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "disc_info.h"
+#include "crc32.h"
+#include "classify.h"
+#include "tune.h"
+
+static const unsigned char PIECE_DATA = 0x00;
+static const unsigned char PIECE_JUNK = 0x01;
+static const unsigned char PIECE_UNIFORM = 0x02;
+
+/**
+ * What we know about each MIN_BLOCK_SIZE piece of the disc
+ */
+struct Piece
+{
+    uint32_t crc;
+    unsigned char kind;
+    unsigned char repeatByte;
+};
+
+/**
+ * Check if a block made of the given pieces is a junk block, a uniform block or data
+ */
+static unsigned char getBlockKind(struct Piece *pieces, size_t count)
+{
+    bool isJunk = true;
+    bool isUniform = true;
+    for (size_t i = 0; i < count; i++) {
+        isJunk = isJunk && pieces[i].kind == PIECE_JUNK;
+        isUniform = isUniform && pieces[i].kind == PIECE_UNIFORM && pieces[i].repeatByte == pieces[0].repeatByte;
+    }
+    if (isJunk) return PIECE_JUNK;
+    if (isUniform) return PIECE_UNIFORM;
+    return PIECE_DATA;
+}
+
+/**
+ * Check if a data block is the same as the data block before it
+ */
+static bool isRepeatBlock(struct Piece *pieces, struct Piece *prevPieces, size_t count, size_t prevCount)
+{
+    if (prevPieces == NULL || count != prevCount) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        // junk copied somewhere else on the disc is data there so only the bytes count
+        bool isUniform = pieces[i].kind == PIECE_UNIFORM;
+        if (isUniform != (prevPieces[i].kind == PIECE_UNIFORM)
+                || pieces[i].repeatByte != prevPieces[i].repeatByte || pieces[i].crc != prevPieces[i].crc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Find the block size that gives the smallest shrunken image
+ *
+ * The image is read once in MIN_BLOCK_SIZE pieces and every block size
+ * is worked out from those pieces.  Smaller blocks leave more junk out
+ * of the image but need a bigger table, bigger blocks need fewer table
+ * entries but every lookup has to read or generate more.
+ */
+size_t tuneBlockSize(char *file)
+{
+    if (file == NULL) {
+        fprintf(stderr, "TUNE ERROR: picking a block size needs an input file\n");
+        return 0;
+    }
+
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "TUNE ERROR: could not open %s\n", file);
+        return 0;
+    }
+
+    unsigned char * buffer = calloc(1, MIN_BLOCK_SIZE);
+
+    size_t read = fread(buffer, 1, MIN_BLOCK_SIZE, f);
+    struct DiscInfo *discInfo = calloc(sizeof(struct DiscInfo), 1);
+    discInfo->blockSize = MIN_BLOCK_SIZE;
+    if (read != MIN_BLOCK_SIZE) {
+        fprintf(stderr, "TUNE ERROR: could not read the first block\n");
+        return 0;
+    }
+    getDiscInfo(discInfo, buffer);
+    if (discInfo->isShrunken || (!discInfo->isGC && !discInfo->isWII)) {
+        fprintf(stderr, "TUNE ERROR: picking a block size needs a full GC or WII image\n");
+        return 0;
+    }
+
+    // enough pieces for the biggest disc
+    size_t maxPieces = (WII_DL_DISC_SIZE + MIN_BLOCK_SIZE - 1) / MIN_BLOCK_SIZE;
+    struct Piece *pieces = calloc(maxPieces, sizeof(struct Piece));
+
+    size_t pieceCount = 0;
+    uint64_t discSize = 0;
+    do {
+        struct BlockClass blockClass = classifyBlock(buffer, read, discSize, discInfo->discId, discInfo->discNumber);
+
+        struct Piece *piece = &pieces[pieceCount];
+        piece->crc = blockClass.crc;
+        if (blockClass.kind == BLOCK_JUNK) {
+            piece->kind = PIECE_JUNK;
+        } else if (blockClass.kind == BLOCK_UNIFORM) {
+            piece->kind = PIECE_UNIFORM;
+            piece->repeatByte = blockClass.repeatByte;
+        } else {
+            piece->kind = PIECE_DATA;
+        }
+        discSize += read;
+        pieceCount++;
+    } while (pieceCount < maxPieces && (read = fread(buffer, 1, MIN_BLOCK_SIZE, f)) > 0);
+    fclose(f);
+    free(buffer);
+
+    discInfo->isDualLayer = discSize > WII_DISC_SIZE;
+
+    fprintf(stderr, "Block Size   Table Size   Data Blocks   Shrunken Size   Read Per Lookup\n");
+
+    size_t bestBlockSize = 0;
+    uint64_t bestSize = 0;
+    for (size_t blockSize = MIN_BLOCK_SIZE; blockSize <= MAX_BLOCK_SIZE; blockSize *= 2) {
+        discInfo->blockSize = blockSize;
+        size_t piecesPerBlock = blockSize / MIN_BLOCK_SIZE;
+
+        size_t dataBlocks = 0;
+        uint64_t shrunkenSize = getTableSize(discInfo);
+        struct Piece *prevPieces = NULL;
+        size_t prevCount = 0;
+        for (size_t first = 0; first < pieceCount; first += piecesPerBlock) {
+            size_t count = (pieceCount - first < piecesPerBlock) ? pieceCount - first : piecesPerBlock;
+            if (getBlockKind(pieces + first, count) != PIECE_DATA) {
+                continue;
+            }
+
+            // only data blocks that are not a repeat of the one before are written
+            if (!isRepeatBlock(pieces + first, prevPieces, count, prevCount)) {
+                dataBlocks++;
+                shrunkenSize += getBlockLength(discInfo, first / piecesPerBlock);
+            }
+            prevPieces = pieces + first;
+            prevCount = count;
+        }
+
+        fprintf(stderr, "0x%-8zx   0x%-8zx   %11zu   %13llu   0x%zx\n", blockSize, getTableSize(discInfo),
+            dataBlocks, (unsigned long long) shrunkenSize, blockSize);
+
+        // on a tie the bigger block size wins since it has less overhead
+        if (bestBlockSize == 0 || shrunkenSize <= bestSize) {
+            bestBlockSize = blockSize;
+            bestSize = shrunkenSize;
+        }
+    }
+    free(pieces);
+
+    fprintf(stderr, "Picked block size 0x%zx\n", bestBlockSize);
+    return bestBlockSize;
+}
@@ -0,0 +1,13 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stddef.h>
+
+/**
+ * Find the block size that gives the smallest shrunken image
+ *
+ * Returns 0 if the image could not be read
+ */
+size_t tuneBlockSize(char *file);
+
+#endif
@@ -0,0 +1,343 @@
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aes.h"
+#include "classify.h"
+#include "hash.h"
+#include "sha1.h"
+#include "wii.h"
+
+// A record starts with the partition data start, title id and encrypted title key
+#define WII_RECORD_HEADER_SIZE 0x20
+
+// H1 and H2 are each a table of 8 SHA-1 hashes
+#define WII_HASH_TABLE_SIZE 0xA0
+#define WII_H1_OFFSET 0x280
+#define WII_H2_OFFSET 0x340
+
+// 8 clusters make a subgroup and 8 subgroups make a group
+#define WII_SUBGROUP_CLUSTERS 8
+#define WII_GROUP_CLUSTERS 64
+
+// A block never covers more than 2 groups since the biggest block is half a group
+#define WII_GROUP_SLOTS 2
+#define WII_MAX_CLUSTERS (0x100000 / WII_CLUSTER_SIZE)
+#define WII_MAX_SUBGROUP_SLOTS (0x100000 / WII_CLUSTER_SIZE / WII_SUBGROUP_CLUSTERS + 1)
+
+static const unsigned char ZERO_IV[16] = {0};
+
+/**
+ * Read a big endian 32 bit number
+ */
+static uint32_t readBE32(unsigned char *data)
+{
+    return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+}
+
+/**
+ * Read length bytes from the given offset of the file
+ */
+static bool readAt(FILE *f, uint64_t offset, unsigned char *buffer, size_t length)
+{
+    return fseeko(f, offset, SEEK_SET) == 0 && fread(buffer, 1, length, f) == length;
+}
+
+/**
+ * The number of H1 tables a record keeps room for, one for
+ * every subgroup the clusters of a block can touch
+ */
+static size_t getSubgroupSlots(size_t clusters)
+{
+    return clusters / WII_SUBGROUP_CLUSTERS + 1;
+}
+
+/**
+ * Build the decrypted hash block of a cluster from its data and its H1 and H2 tables
+ */
+static void buildHashBlock(unsigned char *data, unsigned char *h1, unsigned char *h2, unsigned char hashBlock[WII_CLUSTER_HASH_SIZE])
+{
+    memset(hashBlock, 0, WII_CLUSTER_HASH_SIZE);
+
+    // H0 is a hash of every 0x400 bytes of data in the cluster
+    const unsigned char *pieces[WII_CLUSTER_DATA_SIZE / 0x400];
+    unsigned char *hashes[WII_CLUSTER_DATA_SIZE / 0x400];
+    for (int i = 0; i < WII_CLUSTER_DATA_SIZE / 0x400; i++) {
+        pieces[i] = data + i * 0x400;
+        hashes[i] = hashBlock + i * 20;
+    }
+    sha1Lanes(pieces, WII_CLUSTER_DATA_SIZE / 0x400, 0x400, hashes);
+    memcpy(hashBlock + WII_H1_OFFSET, h1, WII_HASH_TABLE_SIZE);
+    memcpy(hashBlock + WII_H2_OFFSET, h2, WII_HASH_TABLE_SIZE);
+}
+
+/**
+ * Decrypt a title key with the common key
+ */
+static void decryptTitleKey(unsigned char *commonKey, unsigned char titleId[8], unsigned char encryptedTitleKey[16], struct AesKey *titleKey)
+{
+    struct AesKey key;
+    aesSetKey(&key, commonKey);
+
+    // the iv is the title id padded out with zeros
+    unsigned char iv[16] = {0};
+    memcpy(iv, titleId, 8);
+
+    unsigned char plainKey[16];
+    aesCbcDecrypt(&key, iv, encryptedTitleKey, plainKey, 16);
+    aesSetKey(titleKey, plainKey);
+}
+
+/**
+ * Read the 16 byte wii common key from a key file
+ */
+bool readCommonKey(char *file, unsigned char key[16])
+{
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "KEY ERROR: could not open %s\n", file);
+        return false;
+    }
+    bool read = fread(key, 1, 16, f) == 16;
+    fclose(f);
+    if (!read) {
+        fprintf(stderr, "KEY ERROR: %s is not a 16 byte key\n", file);
+    }
+    return read;
+}
+
+/**
+ * Find the partitions of a wii image and decrypt their title keys
+ *
+ * The partition info at 0x40000 has four tables of partitions and every
+ * partition starts with its ticket and a header that says where its data is
+ */
+bool readWiiPartitions(struct DiscInfo *discInfo, char *file)
+{
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "WII ERROR: could not open %s\n", file);
+        return false;
+    }
+
+    unsigned char info[0x20];
+    if (!readAt(f, WII_PARTITION_INFO_OFFSET, info, sizeof(info))) {
+        fprintf(stderr, "WII ERROR: could not read the partition info\n");
+        fclose(f);
+        return false;
+    }
+
+    for (int table = 0; table < 4; table++) {
+        uint32_t count = readBE32(info + table * 8);
+        uint64_t tableOffset = (uint64_t) readBE32(info + table * 8 + 4) << 2;
+
+        for (uint32_t i = 0; i < count && i < 0x40; i++) {
+            unsigned char entry[8];
+            unsigned char header[0x2C0];
+            if (!readAt(f, tableOffset + i * 8, entry, sizeof(entry))) {
+                break;
+            }
+            uint64_t partitionOffset = (uint64_t) readBE32(entry) << 2;
+            if (!readAt(f, partitionOffset, header, sizeof(header))) {
+                fprintf(stderr, "WII ERROR: could not read the partition at %llx\n", (unsigned long long) partitionOffset);
+                continue;
+            }
+
+            // only partitions using the common key we were given can be decrypted
+            if (header[0x1F1] != 0) {
+                fprintf(stderr, "Skipping partition at %llx, it uses common key %d\n", (unsigned long long) partitionOffset, header[0x1F1]);
+                continue;
+            }
+
+            discInfo->partitions = realloc(discInfo->partitions, (discInfo->partitionCount + 1) * sizeof(struct WiiPartition));
+            struct WiiPartition *partition = &discInfo->partitions[discInfo->partitionCount++];
+            partition->dataStart = partitionOffset + ((uint64_t) readBE32(header + 0x2B8) << 2);
+            partition->dataSize = (uint64_t) readBE32(header + 0x2BC) << 2;
+            memcpy(partition->encryptedTitleKey, header + 0x1BF, 16);
+            memcpy(partition->titleId, header + 0x1DC, 8);
+            decryptTitleKey(discInfo->commonKey, partition->titleId, partition->encryptedTitleKey, &partition->titleKey);
+
+            fprintf(stderr, "Partition data at %llx, %llx bytes\n",
+                (unsigned long long) partition->dataStart, (unsigned long long) partition->dataSize);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * Get the partition whose data holds the whole block, or NULL
+ */
+struct WiiPartition * getWiiPartition(struct DiscInfo *discInfo, size_t blockNum)
+{
+    uint64_t start = (uint64_t) blockNum * discInfo->blockSize;
+    uint64_t end = start + discInfo->blockSize;
+    for (size_t i = 0; i < discInfo->partitionCount; i++) {
+        struct WiiPartition *partition = &discInfo->partitions[i];
+        if (start >= partition->dataStart && end <= partition->dataStart + partition->dataSize
+                && (start - partition->dataStart) % WII_CLUSTER_SIZE == 0) {
+            return partition;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Check if byte 3 of a table entry marks a decrypted partition block
+ */
+bool isWiiPartitionMarker(unsigned char marker)
+{
+    return marker == WII_PARTITION_DATA || marker == WII_PARTITION_UNIFORM || marker == WII_PARTITION_JUNK;
+}
+
+/**
+ * Get the size of the record stored for a decrypted partition block
+ *
+ * Data records keep the decrypted data, uniform records keep the
+ * repeated byte and junk records keep nothing.  After that every record
+ * keeps the H1 and H2 tables for the subgroups and groups the block
+ * touches, H0 and the padding are always rebuilt from the data.
+ */
+size_t getWiiRecordSize(size_t blockSize, unsigned char marker)
+{
+    size_t clusters = blockSize / WII_CLUSTER_SIZE;
+    size_t payload = 0;
+    if (marker == WII_PARTITION_DATA) {
+        payload = clusters * WII_CLUSTER_DATA_SIZE;
+    } else if (marker == WII_PARTITION_UNIFORM) {
+        payload = 1;
+    }
+    return WII_RECORD_HEADER_SIZE + payload + (getSubgroupSlots(clusters) + WII_GROUP_SLOTS) * WII_HASH_TABLE_SIZE;
+}
+
+/**
+ * Decrypt a partition block and check that it can be rebuilt bit for bit
+ *
+ * Returns the size of the record to store and sets the table marker,
+ * or 0 if the block has to be stored as it is
+ */
+size_t shrinkWiiBlock(struct DiscInfo *discInfo, struct WiiPartition *partition, size_t blockNum,
+        const unsigned char *block, unsigned char *record, unsigned char *marker)
+{
+    size_t clusters = discInfo->blockSize / WII_CLUSTER_SIZE;
+    size_t subgroupSlots = getSubgroupSlots(clusters);
+    uint64_t firstCluster = ((uint64_t) blockNum * discInfo->blockSize - partition->dataStart) / WII_CLUSTER_SIZE;
+
+    unsigned char tables[(WII_MAX_SUBGROUP_SLOTS + WII_GROUP_SLOTS) * WII_HASH_TABLE_SIZE] = {0};
+    bool filled[WII_MAX_SUBGROUP_SLOTS + WII_GROUP_SLOTS] = {false};
+    unsigned char hashBlock[WII_CLUSTER_HASH_SIZE];
+    unsigned char rebuilt[WII_CLUSTER_HASH_SIZE];
+
+    // decrypt straight into the record
+    unsigned char *plain = record + WII_RECORD_HEADER_SIZE;
+    for (size_t c = 0; c < clusters; c++) {
+        const unsigned char *cluster = block + c * WII_CLUSTER_SIZE;
+        unsigned char *data = plain + c * WII_CLUSTER_DATA_SIZE;
+
+        // the hashes use a zero iv and the data uses part of the encrypted hashes as its iv
+        aesCbcDecrypt(&partition->titleKey, ZERO_IV, cluster, hashBlock, WII_CLUSTER_HASH_SIZE);
+        aesCbcDecrypt(&partition->titleKey, cluster + 0x3D0, cluster + WII_CLUSTER_HASH_SIZE, data, WII_CLUSTER_DATA_SIZE);
+
+        // keep the first H1 and H2 tables seen for each subgroup and group
+        uint64_t clusterNum = firstCluster + c;
+        size_t subgroupSlot = clusterNum / WII_SUBGROUP_CLUSTERS - firstCluster / WII_SUBGROUP_CLUSTERS;
+        size_t groupSlot = subgroupSlots + clusterNum / WII_GROUP_CLUSTERS - firstCluster / WII_GROUP_CLUSTERS;
+        if (!filled[subgroupSlot]) {
+            memcpy(tables + subgroupSlot * WII_HASH_TABLE_SIZE, hashBlock + WII_H1_OFFSET, WII_HASH_TABLE_SIZE);
+            filled[subgroupSlot] = true;
+        }
+        if (!filled[groupSlot]) {
+            memcpy(tables + groupSlot * WII_HASH_TABLE_SIZE, hashBlock + WII_H2_OFFSET, WII_HASH_TABLE_SIZE);
+            filled[groupSlot] = true;
+        }
+
+        // if anything in the hashes does not come back the block is stored encrypted
+        buildHashBlock(data, tables + subgroupSlot * WII_HASH_TABLE_SIZE, tables + groupSlot * WII_HASH_TABLE_SIZE, rebuilt);
+        if (memcmp(rebuilt, hashBlock, WII_CLUSTER_HASH_SIZE) != 0) {
+            return 0;
+        }
+    }
+
+    // junk inside a partition is generated from the offset in the decrypted data
+    struct BlockClass blockClass = classifyBlock(plain, clusters * WII_CLUSTER_DATA_SIZE,
+        firstCluster * WII_CLUSTER_DATA_SIZE, discInfo->discId, discInfo->discNumber);
+    if (blockClass.kind == BLOCK_JUNK) {
+        *marker = WII_PARTITION_JUNK;
+    } else if (blockClass.kind == BLOCK_UNIFORM) {
+        *marker = WII_PARTITION_UNIFORM;
+        plain[0] = blockClass.repeatByte;
+    } else {
+        *marker = WII_PARTITION_DATA;
+    }
+
+    memcpy(record, &partition->dataStart, 8);
+    memcpy(record + 8, partition->titleId, 8);
+    memcpy(record + 16, partition->encryptedTitleKey, 16);
+
+    size_t recordSize = getWiiRecordSize(discInfo->blockSize, *marker);
+    size_t tablesSize = (subgroupSlots + WII_GROUP_SLOTS) * WII_HASH_TABLE_SIZE;
+    memcpy(record + recordSize - tablesSize, tables, tablesSize);
+    return recordSize;
+}
+
+/**
+ * Rebuild the encrypted partition block from its record
+ */
+bool unshrinkWiiBlock(struct DiscInfo *discInfo, size_t blockNum, unsigned char marker,
+        unsigned char *record, unsigned char *block)
+{
+    if (discInfo->commonKey == NULL) {
+        return false;
+    }
+
+    uint64_t dataStart;
+    memcpy(&dataStart, record, 8);
+    struct AesKey titleKey;
+    decryptTitleKey(discInfo->commonKey, record + 8, record + 16, &titleKey);
+
+    size_t clusters = discInfo->blockSize / WII_CLUSTER_SIZE;
+    size_t subgroupSlots = getSubgroupSlots(clusters);
+    uint64_t firstCluster = ((uint64_t) blockNum * discInfo->blockSize - dataStart) / WII_CLUSTER_SIZE;
+
+    size_t recordSize = getWiiRecordSize(discInfo->blockSize, marker);
+    unsigned char *tables = record + recordSize - (subgroupSlots + WII_GROUP_SLOTS) * WII_HASH_TABLE_SIZE;
+
+    struct JunkStream stream;
+    initJunkStream(&stream, discInfo->discId, discInfo->discNumber, firstCluster * WII_CLUSTER_DATA_SIZE);
+
+    // lay every cluster out decrypted where it goes in the block
+    const unsigned char *hashIvs[WII_MAX_CLUSTERS];
+    const unsigned char *dataIvs[WII_MAX_CLUSTERS];
+    unsigned char *hashBlocks[WII_MAX_CLUSTERS];
+    unsigned char *datas[WII_MAX_CLUSTERS];
+    for (size_t c = 0; c < clusters; c++) {
+        unsigned char *cluster = block + c * WII_CLUSTER_SIZE;
+        unsigned char *data = cluster + WII_CLUSTER_HASH_SIZE;
+        if (marker == WII_PARTITION_DATA) {
+            memcpy(data, record + WII_RECORD_HEADER_SIZE + c * WII_CLUSTER_DATA_SIZE, WII_CLUSTER_DATA_SIZE);
+        } else if (marker == WII_PARTITION_JUNK) {
+            readJunkStream(&stream, data, WII_CLUSTER_DATA_SIZE);
+        } else {
+            memset(data, record[WII_RECORD_HEADER_SIZE], WII_CLUSTER_DATA_SIZE);
+        }
+
+        uint64_t clusterNum = firstCluster + c;
+        size_t subgroupSlot = clusterNum / WII_SUBGROUP_CLUSTERS - firstCluster / WII_SUBGROUP_CLUSTERS;
+        size_t groupSlot = subgroupSlots + clusterNum / WII_GROUP_CLUSTERS - firstCluster / WII_GROUP_CLUSTERS;
+        buildHashBlock(data, tables + subgroupSlot * WII_HASH_TABLE_SIZE, tables + groupSlot * WII_HASH_TABLE_SIZE, cluster);
+
+        // the data iv is the end of the encrypted hashes so those go first
+        hashIvs[c] = ZERO_IV;
+        hashBlocks[c] = cluster;
+        dataIvs[c] = cluster + 0x3D0;
+        datas[c] = data;
+    }
+
+    // every cluster is encrypted on its own so they can all go at once
+    aesCbcEncryptLanes(&titleKey, hashIvs, hashBlocks, clusters, WII_CLUSTER_HASH_SIZE);
+    aesCbcEncryptLanes(&titleKey, dataIvs, datas, clusters, WII_CLUSTER_DATA_SIZE);
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef WII_H
+#define WII_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "aes.h"
+#include "disc_info.h"
+
+// Wii partition data is encrypted in 0x8000 byte clusters,
+// 0x400 bytes of hashes followed by 0x7C00 bytes of data
+#define WII_CLUSTER_SIZE 0x8000
+#define WII_CLUSTER_HASH_SIZE 0x400
+#define WII_CLUSTER_DATA_SIZE 0x7C00
+
+static const uint64_t WII_PARTITION_INFO_OFFSET = 0x40000;
+
+// Byte 3 of a table entry for a block that was decrypted and can be rebuilt
+static const unsigned char WII_PARTITION_DATA = 0xFD;
+static const unsigned char WII_PARTITION_UNIFORM = 0xFC;
+static const unsigned char WII_PARTITION_JUNK = 0xFB;
+
+struct WiiPartition
+{
+    uint64_t dataStart;
+    uint64_t dataSize;
+    unsigned char titleId[8];
+    unsigned char encryptedTitleKey[16];
+    struct AesKey titleKey;
+};
+
+/**
+ * Read the 16 byte wii common key from a key file
+ */
+bool readCommonKey(char *file, unsigned char key[16]);
+
+/**
+ * Find the partitions of a wii image and decrypt their title keys
+ */
+bool readWiiPartitions(struct DiscInfo *discInfo, char *file);
+
+/**
+ * Get the partition whose data holds the whole block, or NULL
+ */
+struct WiiPartition * getWiiPartition(struct DiscInfo *discInfo, size_t blockNum);
+
+/**
+ * Check if byte 3 of a table entry marks a decrypted partition block
+ */
+bool isWiiPartitionMarker(unsigned char marker);
+
+/**
+ * Get the size of the record stored for a decrypted partition block
+ */
+size_t getWiiRecordSize(size_t blockSize, unsigned char marker);
+
+/**
+ * Decrypt a partition block and check that it can be rebuilt bit for bit
+ *
+ * Returns the size of the record to store and sets the table marker,
+ * or 0 if the block has to be stored as it is
+ */
+size_t shrinkWiiBlock(struct DiscInfo *discInfo, struct WiiPartition *partition, size_t blockNum,
+        const unsigned char *block, unsigned char *record, unsigned char *marker);
+
+/**
+ * Rebuild the encrypted partition block from its record
+ *
+ * Returns false if the disc info has no common key
+ */
+bool unshrinkWiiBlock(struct DiscInfo *discInfo, size_t blockNum, unsigned char marker,
+        unsigned char *record, unsigned char *block);
+
+#endif
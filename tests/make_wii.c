@@ -0,0 +1,161 @@
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "aes.h"
+#include "sha1.h"
+#include "hash.h"
+#include "disc_info.h"
+#include "wii.h"
+
+// One partition of 6 groups of 64 clusters, everything else on the disc is left as zeros
+#define PARTITION_OFFSET 0xF800000ULL
+#define PARTITION_DATA_OFFSET 0x20000ULL
+#define CLUSTERS (64 * 6)
+
+// The cluster whose hash padding is not zero, so the block holding it can not be rebuilt
+#define ODD_PADDING_CLUSTER 300
+
+static const unsigned char DISC_ID[7] = "RTSTE1";
+
+static void writeBE32(unsigned char *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+/**
+ * Fill a cluster of plain data, the partition is split into runs of
+ * random data, zeros, partition junk and a uniform byte
+ */
+static void fillCluster(unsigned char *data, int cluster)
+{
+    if (cluster < 80 || cluster >= 320) {
+        for (int i = 0; i < WII_CLUSTER_DATA_SIZE; i++) data[i] = (unsigned char) rand();
+    } else if (cluster < 160) {
+        memset(data, 0, WII_CLUSTER_DATA_SIZE);
+    } else if (cluster < 240) {
+        getJunk(data, (uint64_t) cluster * WII_CLUSTER_DATA_SIZE, WII_CLUSTER_DATA_SIZE, (unsigned char *) DISC_ID, 0);
+    } else {
+        memset(data, 0x5A, WII_CLUSTER_DATA_SIZE);
+    }
+}
+
+/**
+ * Write a single layer wii image with one partition encrypted with a
+ * test common key, and the key file that goes with it
+ */
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s image keyFile\n", argv[0]);
+        return 1;
+    }
+
+    unsigned char commonKey[16], titleKey[16], encryptedTitleKey[16];
+    unsigned char titleId[8] = {0, 1, 0, 0, 'R', 'T', 'S', 'T'};
+    for (int i = 0; i < 16; i++) {
+        commonKey[i] = (unsigned char) (0x11 * i + 3);
+        titleKey[i] = (unsigned char) (0xA0 + i * 7);
+    }
+
+    FILE *keyF = fopen(argv[2], "wb");
+    if (keyF == NULL || fwrite(commonKey, 1, 16, keyF) != 16) {
+        fprintf(stderr, "TEST ERROR: could not write %s\n", argv[2]);
+        return 1;
+    }
+    fclose(keyF);
+
+    // the title key is encrypted with the common key using the title id as the iv
+    struct AesKey commonAes, titleAes;
+    aesSetKey(&commonAes, commonKey);
+    unsigned char iv[16] = {0};
+    memcpy(iv, titleId, 8);
+    aesCbcEncrypt(&commonAes, iv, titleKey, encryptedTitleKey, 16);
+    aesSetKey(&titleAes, titleKey);
+
+    FILE *f = fopen(argv[1], "wb");
+    if (f == NULL) {
+        fprintf(stderr, "TEST ERROR: could not write %s\n", argv[1]);
+        return 1;
+    }
+
+    // the disc header with the wii magic word and the partition info
+    unsigned char *buffer = calloc(1, PARTITION_DATA_OFFSET);
+    memcpy(buffer, DISC_ID, 6);
+    memcpy(buffer + 24, WII_MAGIC_WORD, 4);
+    strcpy((char *) buffer + 32, "WII TEST");
+    fwrite(buffer, 1, 0x400, f);
+
+    memset(buffer, 0, 0x40);
+    writeBE32(buffer, 1);
+    writeBE32(buffer + 4, 0x40020 >> 2);
+    writeBE32(buffer + 0x20, PARTITION_OFFSET >> 2);
+    fseeko(f, 0x40000, SEEK_SET);
+    fwrite(buffer, 1, 0x40, f);
+
+    // the partition header with the ticket and where the data is
+    memset(buffer, 0, PARTITION_DATA_OFFSET);
+    memcpy(buffer + 0x1BF, encryptedTitleKey, 16);
+    memcpy(buffer + 0x1DC, titleId, 8);
+    writeBE32(buffer + 0x2B8, PARTITION_DATA_OFFSET >> 2);
+    writeBE32(buffer + 0x2BC, (uint32_t) (((uint64_t) CLUSTERS * WII_CLUSTER_SIZE) >> 2));
+    fseeko(f, PARTITION_OFFSET, SEEK_SET);
+    fwrite(buffer, 1, PARTITION_DATA_OFFSET, f);
+    free(buffer);
+
+    // the hashes go H0 for every 0x400 bytes of a cluster, H1 over the H0s
+    // of 8 clusters and H2 over the H1s of 64 clusters
+    srand(7);
+    unsigned char *plain = malloc((size_t) CLUSTERS * WII_CLUSTER_DATA_SIZE);
+    unsigned char (*h0)[0x26C] = calloc(CLUSTERS, 0x26C);
+    unsigned char (*h1)[0xA0] = calloc(CLUSTERS / 8, 0xA0);
+    unsigned char (*h2)[0xA0] = calloc(CLUSTERS / 64, 0xA0);
+    for (int c = 0; c < CLUSTERS; c++) {
+        fillCluster(plain + (size_t) c * WII_CLUSTER_DATA_SIZE, c);
+        for (int i = 0; i < 31; i++) {
+            sha1(plain + (size_t) c * WII_CLUSTER_DATA_SIZE + i * 0x400, 0x400, h0[c] + i * 20);
+        }
+    }
+    for (int s = 0; s < CLUSTERS / 8; s++) {
+        for (int i = 0; i < 8; i++) sha1(h0[s * 8 + i], 0x26C, h1[s] + i * 20);
+    }
+    for (int g = 0; g < CLUSTERS / 64; g++) {
+        for (int i = 0; i < 8; i++) sha1(h1[g * 8 + i], 0xA0, h2[g] + i * 20);
+    }
+
+    unsigned char cluster[WII_CLUSTER_SIZE];
+    unsigned char hashBlock[0x400];
+    unsigned char zeroIv[16] = {0};
+    for (int c = 0; c < CLUSTERS; c++) {
+        memset(hashBlock, 0, sizeof(hashBlock));
+        memcpy(hashBlock, h0[c], 0x26C);
+        memcpy(hashBlock + 0x280, h1[c / 8], 0xA0);
+        memcpy(hashBlock + 0x340, h2[c / 64], 0xA0);
+        if (c == ODD_PADDING_CLUSTER) {
+            hashBlock[0x26C] = 1;
+        }
+        aesCbcEncrypt(&titleAes, zeroIv, hashBlock, cluster, 0x400);
+        aesCbcEncrypt(&titleAes, cluster + 0x3D0, plain + (size_t) c * WII_CLUSTER_DATA_SIZE, cluster + 0x400, WII_CLUSTER_DATA_SIZE);
+        fwrite(cluster, 1, WII_CLUSTER_SIZE, f);
+    }
+
+    // the rest of the disc is zeros, leave it as a hole in the file
+    if (fflush(f) != 0 || ftruncate(fileno(f), WII_DISC_SIZE) != 0) {
+        fprintf(stderr, "TEST ERROR: could not size %s\n", argv[1]);
+        return 1;
+    }
+    fclose(f);
+    free(plain);
+    free(h0);
+    free(h1);
+    free(h2);
+    return 0;
+}
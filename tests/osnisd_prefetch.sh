@@ -0,0 +1,66 @@
+#!/bin/sh
+# Serve a shrunken image with a manifest from a cache that only holds one
+# block, replay the reads the manifest was made from and check that the
+# daemon prefetched blocks and the session read them from the cache, and
+# that a read past the end of the disc fails on its own
+#
+# usage: osnisd_prefetch.sh osnis osnisd osnisd_load
+
+OSNIS=$1
+OSNISD=$2
+LOAD=$3
+DIR=$(mktemp -d)
+trap 'kill $DAEMON 2> /dev/null; rm -rf "$DIR"' EXIT
+
+# a gamecube image with 8 blocks of random data after the header and
+# zeros everywhere else
+truncate -s 1459978240 "$DIR/gc.iso"
+printf 'GTSTE1' | dd of="$DIR/gc.iso" conv=notrunc 2> /dev/null
+printf '\302\063\237\075GC TEST' | dd of="$DIR/gc.iso" bs=1 seek=28 conv=notrunc 2> /dev/null
+dd if=/dev/urandom of="$DIR/gc.iso" bs=1048576 seek=1 count=8 conv=notrunc 2> /dev/null
+
+# one read of each 0x100000 byte block, in the order a session would read them
+for BLOCK in 3 1 2 8 4 5 7 6; do
+    printf '0x%x 0x100000\n' $((BLOCK * 0x100000))
+done > "$DIR/trace.txt"
+
+"$OSNIS" -s -b 0x100000 -i "$DIR/gc.iso" -o "$DIR/gc.osnis" 2> /dev/null || exit 1
+"$OSNIS" -m "$DIR/trace.txt" -i "$DIR/gc.osnis" -o "$DIR/manifest.osnis" 2> /dev/null || exit 1
+
+"$OSNISD" -S "$DIR/osnisd.sock" -m 1 2> "$DIR/osnisd.log" &
+DAEMON=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$DIR/osnisd.sock" ] && break
+    sleep 0.2
+done
+
+# a read past the end of the disc has to fail without taking the daemon down
+printf '0x60000000 0x8000\n0x4000000000000000 0x8000\n' > "$DIR/past.txt"
+if "$LOAD" -S "$DIR/osnisd.sock" -i "$DIR/manifest.osnis" -c 1 -t "$DIR/past.txt" 2> "$DIR/past.log"; then
+    echo "TEST ERROR: a read past the end of the disc did not fail" >&2
+    exit 1
+fi
+if ! kill -0 $DAEMON 2> /dev/null; then
+    echo "TEST ERROR: the daemon stopped after a read past the end of the disc" >&2
+    cat "$DIR/osnisd.log" >&2
+    exit 1
+fi
+
+if ! "$LOAD" -S "$DIR/osnisd.sock" -i "$DIR/manifest.osnis" -c 1 -t "$DIR/trace.txt" -v "$DIR/gc.iso" 2> "$DIR/load.log"; then
+    echo "TEST ERROR: the reads through the daemon did not match" >&2
+    cat "$DIR/load.log" >&2
+    exit 1
+fi
+kill -INT $DAEMON
+wait $DAEMON
+
+# Cache hits: N misses: N prefetched: N
+STATS=$(grep "Cache hits:" "$DIR/osnisd.log")
+HITS=$(echo "$STATS" | awk '{print $3}')
+PREFETCHED=$(echo "$STATS" | awk '{print $7}')
+if [ -z "$PREFETCHED" ] || [ "$PREFETCHED" -eq 0 ] || [ "$HITS" -eq 0 ]; then
+    echo "TEST ERROR: expected prefetched blocks to be read from the cache" >&2
+    cat "$DIR/osnisd.log" >&2
+    exit 1
+fi
+echo "osnisd prefetch passed, $STATS" >&2
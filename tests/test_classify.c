@@ -0,0 +1,90 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "crc32.h"
+#include "classify.h"
+
+static int failures = 0;
+
+static unsigned char id[4] = {'G', 'T', 'S', 'T'};
+
+/**
+ * Classify the block and check it against a plain byte by byte answer
+ */
+static void check(const char *name, const unsigned char *block, size_t length, uint64_t offset)
+{
+    unsigned char *junk = malloc(length);
+    getJunk(junk, offset, length, id, 0);
+    bool isJunk = memcmp(block, junk, length) == 0;
+    bool isUniform = true;
+    for (size_t i = 1; i < length; i++) {
+        isUniform = isUniform && block[i] == block[0];
+    }
+    free(junk);
+
+    struct BlockClass expected = {crc32(block, length, 0), BLOCK_DATA, 0};
+    if (isJunk) {
+        expected.kind = BLOCK_JUNK;
+    } else if (isUniform) {
+        expected.kind = BLOCK_UNIFORM;
+        expected.repeatByte = block[0];
+    }
+
+    struct BlockClass result = classifyBlock(block, length, offset, id, 0);
+    if (result.kind != expected.kind || result.crc != expected.crc || result.repeatByte != expected.repeatByte) {
+        fprintf(stderr, "TEST ERROR: %s of 0x%zx bytes at 0x%llx was kind %d crc %x but should be kind %d crc %x\n",
+            name, length, (unsigned long long) offset, result.kind, result.crc, expected.kind, expected.crc);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    // whole blocks of every size and short last blocks, with lengths on
+    // both sides of the 128 byte steps and the chunk size
+    size_t lengths[] = {0x100000, 0x40000, 0x8000, 0x2000 + 129, 0x2000, 0x2000 - 1, 1000, 129, 128, 127, 1};
+    unsigned char *block = malloc(0x100000);
+    srand(1);
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        size_t length = lengths[l];
+        uint64_t offset = 0x40000 * (l + 1);
+
+        getJunk(block, offset, length, id, 0);
+        check("junk", block, length, offset);
+
+        // one byte off early, at the end of an avx2 step and right at the end
+        size_t changes[] = {0, length / 2, (length & ~(size_t) 127) - 1, length - 1};
+        for (size_t c = 0; c < sizeof(changes) / sizeof(changes[0]); c++) {
+            if (changes[c] >= length) {
+                continue;
+            }
+            getJunk(block, offset, length, id, 0);
+            block[changes[c]] ^= 0x01;
+            check("junk with a changed byte", block, length, offset);
+
+            memset(block, 0xa5, length);
+            block[changes[c]] ^= 0x01;
+            check("uniform with a changed byte", block, length, offset);
+        }
+
+        memset(block, 0x00, length);
+        check("zeros", block, length, offset);
+        memset(block, 0xff, length);
+        check("uniform", block, length, offset);
+
+        for (size_t i = 0; i < length; i++) block[i] = (unsigned char) rand();
+        check("data", block, length, offset);
+    }
+    free(block);
+
+    const char *path = (getenv("OSNIS_NO_SIMD") != NULL) ? "software" : "default";
+    if (failures > 0) {
+        fprintf(stderr, "%d classify tests failed on the %s path\n", failures, path);
+        return 1;
+    }
+    fprintf(stderr, "classify tests passed on the %s path\n", path);
+    return 0;
+}
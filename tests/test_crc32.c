@@ -0,0 +1,63 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crc32.h"
+
+static int failures = 0;
+
+static void check(const char *name, bool passed)
+{
+    if (!passed) {
+        fprintf(stderr, "TEST ERROR: %s\n", name);
+        failures++;
+    }
+}
+
+/**
+ * The crc a bit at a time, the way the polynomial is written down
+ */
+static uint32_t crc32Bitwise(const unsigned char *buf, size_t len, uint32_t crc)
+{
+    while (len--) {
+        crc ^= (uint32_t) *buf++ << 24;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+int main(void)
+{
+    // CRC-32/MPEG-2 is this crc started from all ones
+    check("crc32 check value", crc32((const unsigned char *) "123456789", 9, 0xFFFFFFFF) == 0x0376E6E7);
+    check("crc32 empty", crc32(NULL, 0, 0x12345678) == 0x12345678);
+
+    // every length on both sides of the 16 and 64 byte steps, from any
+    // alignment, and carried on from another crc like a chunked block
+    unsigned char *buf = malloc(0x2000 + 3);
+    srand(1);
+    for (int i = 0; i < 0x2000 + 3; i++) buf[i] = (unsigned char) rand();
+    for (size_t len = 0; len <= 600; len++) {
+        for (int align = 0; align < 3; align++) {
+            uint32_t init = ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+            if (crc32(buf + align, len, init) != crc32Bitwise(buf + align, len, init)) {
+                char name[64];
+                snprintf(name, sizeof(name), "crc32 of %zu bytes at alignment %d", len, align);
+                check(name, false);
+            }
+        }
+    }
+    uint32_t chunked = crc32(buf + 0x1000, 0x1000, crc32(buf, 0x1000, 0));
+    check("crc32 chunked", chunked == crc32(buf, 0x2000, 0) && chunked == crc32Bitwise(buf, 0x2000, 0));
+    free(buf);
+
+    const char *path = (getenv("OSNIS_NO_SIMD") != NULL) ? "software" : "default";
+    if (failures > 0) {
+        fprintf(stderr, "%d crc32 tests failed on the %s path\n", failures, path);
+        return 1;
+    }
+    fprintf(stderr, "crc32 tests passed on the %s path\n", path);
+    return 0;
+}
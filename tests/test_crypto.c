@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aes.h"
+#include "sha1.h"
+
+static int failures = 0;
+
+/**
+ * Turn a hex string into bytes
+ */
+static size_t fromHex(const char *hex, unsigned char *out)
+{
+    size_t length = strlen(hex) / 2;
+    for (size_t i = 0; i < length; i++) {
+        unsigned int byte;
+        sscanf(hex + i * 2, "%2x", &byte);
+        out[i] = (unsigned char) byte;
+    }
+    return length;
+}
+
+static void check(const char *name, bool passed)
+{
+    if (!passed) {
+        fprintf(stderr, "TEST ERROR: %s\n", name);
+        failures++;
+    }
+}
+
+/**
+ * Known answers from FIPS-197 appendix C.1 and SP 800-38A F.2.1 and F.2.2
+ */
+static void testAesVectors(void)
+{
+    unsigned char key[16], iv[16], plain[64], cipher[64], out[64];
+    struct AesKey aesKey;
+
+    // a single block with a zero iv is the same as the plain block cipher
+    fromHex("000102030405060708090a0b0c0d0e0f", key);
+    fromHex("00112233445566778899aabbccddeeff", plain);
+    fromHex("69c4e0d86a7b0430d8cdb78070b4c55a", cipher);
+    memset(iv, 0, 16);
+    aesSetKey(&aesKey, key);
+    aesCbcEncrypt(&aesKey, iv, plain, out, 16);
+    check("aes fips-197 encrypt", memcmp(out, cipher, 16) == 0);
+    aesCbcDecrypt(&aesKey, iv, cipher, out, 16);
+    check("aes fips-197 decrypt", memcmp(out, plain, 16) == 0);
+
+    fromHex("2b7e151628aed2a6abf7158809cf4f3c", key);
+    fromHex("000102030405060708090a0b0c0d0e0f", iv);
+    fromHex("6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+            "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710", plain);
+    fromHex("7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+            "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7", cipher);
+    aesSetKey(&aesKey, key);
+    aesCbcEncrypt(&aesKey, iv, plain, out, 64);
+    check("aes sp800-38a cbc encrypt", memcmp(out, cipher, 64) == 0);
+    aesCbcDecrypt(&aesKey, iv, cipher, out, 64);
+    check("aes sp800-38a cbc decrypt", memcmp(out, plain, 64) == 0);
+
+    // decrypting in place has to hold on to each cipher block for the next one
+    memcpy(out, cipher, 64);
+    aesCbcDecrypt(&aesKey, iv, out, out, 64);
+    check("aes sp800-38a cbc decrypt in place", memcmp(out, plain, 64) == 0);
+
+    // the four wide decrypt has a tail for lengths that are not a multiple of 64
+    aesCbcDecrypt(&aesKey, iv, cipher, out, 48);
+    check("aes sp800-38a cbc decrypt tail", memcmp(out, plain, 48) == 0);
+}
+
+/**
+ * Encrypting lanes has to give the same as encrypting each buffer on its own
+ */
+static void testAesLanes(void)
+{
+    unsigned char key[16];
+    for (int i = 0; i < 16; i++) key[i] = (unsigned char) (i * 13 + 5);
+    struct AesKey aesKey;
+    aesSetKey(&aesKey, key);
+
+    size_t length = 0x400;
+    for (size_t count = 0; count <= 9; count++) {
+        unsigned char *expected = malloc(count * length + 1);
+        unsigned char *actual = malloc(count * length + 1);
+        unsigned char ivData[9][16];
+        const unsigned char *ivs[9];
+        unsigned char *buffers[9];
+        for (size_t i = 0; i < count * length; i++) {
+            actual[i] = (unsigned char) rand();
+        }
+        for (size_t lane = 0; lane < count; lane++) {
+            for (int j = 0; j < 16; j++) ivData[lane][j] = (unsigned char) rand();
+            ivs[lane] = ivData[lane];
+            buffers[lane] = actual + lane * length;
+            aesCbcEncrypt(&aesKey, ivs[lane], buffers[lane], expected + lane * length, length);
+        }
+        aesCbcEncryptLanes(&aesKey, ivs, buffers, count, length);
+
+        char name[64];
+        snprintf(name, sizeof(name), "aes lanes with %zu buffers", count);
+        check(name, memcmp(actual, expected, count * length) == 0);
+        free(expected);
+        free(actual);
+    }
+}
+
+/**
+ * Known answers from FIPS 180 and RFC 3174
+ */
+static void testSha1Vectors(void)
+{
+    unsigned char hash[20], expected[20];
+
+    sha1((const unsigned char *) "abc", 3, hash);
+    fromHex("a9993e364706816aba3e25717850c26c9cd0d89d", expected);
+    check("sha1 abc", memcmp(hash, expected, 20) == 0);
+
+    sha1((const unsigned char *) "", 0, hash);
+    fromHex("da39a3ee5e6b4b0d3255bfef95601890afd80709", expected);
+    check("sha1 empty", memcmp(hash, expected, 20) == 0);
+
+    const char *twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    sha1((const unsigned char *) twoBlocks, strlen(twoBlocks), hash);
+    fromHex("84983e441c3bd26ebaae4aa1f95129e5e54670f1", expected);
+    check("sha1 448 bits", memcmp(hash, expected, 20) == 0);
+
+    unsigned char *million = malloc(1000000);
+    memset(million, 'a', 1000000);
+    sha1(million, 1000000, hash);
+    fromHex("34aa973cd4c4daa4f61eeb2bdbad27316534016f", expected);
+    check("sha1 million a", memcmp(hash, expected, 20) == 0);
+
+    // the lanes have to agree with the known answer too
+    const unsigned char *bufs[5] = {million, million, million, million, million};
+    unsigned char hashes[5][20];
+    unsigned char *outs[5] = {hashes[0], hashes[1], hashes[2], hashes[3], hashes[4]};
+    sha1Lanes(bufs, 5, 1000000, outs);
+    for (int i = 0; i < 5; i++) {
+        check("sha1 lanes million a", memcmp(hashes[i], expected, 20) == 0);
+    }
+    free(million);
+}
+
+/**
+ * Hashing lanes has to give the same as hashing each buffer on its own,
+ * for lengths on both sides of where the padding needs another chunk
+ */
+static void testSha1Lanes(void)
+{
+    static const size_t lengths[] = {0, 1, 55, 56, 63, 64, 119, 0x400};
+    unsigned char data[9][0x400];
+    for (int lane = 0; lane < 9; lane++) {
+        for (int i = 0; i < 0x400; i++) data[lane][i] = (unsigned char) rand();
+    }
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        for (size_t count = 1; count <= 9; count++) {
+            const unsigned char *bufs[9];
+            unsigned char hashes[9][20];
+            unsigned char *outs[9];
+            for (size_t lane = 0; lane < count; lane++) {
+                bufs[lane] = data[lane];
+                outs[lane] = hashes[lane];
+            }
+            sha1Lanes(bufs, count, lengths[l], outs);
+
+            bool same = true;
+            for (size_t lane = 0; lane < count; lane++) {
+                unsigned char expected[20];
+                sha1(data[lane], lengths[l], expected);
+                same = same && memcmp(hashes[lane], expected, 20) == 0;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "sha1 lanes with %zu buffers of %zu bytes", count, lengths[l]);
+            check(name, same);
+        }
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    testAesVectors();
+    testAesLanes();
+    testSha1Vectors();
+    testSha1Lanes();
+
+    const char *path = (getenv("OSNIS_NO_SIMD") != NULL) ? "software" : "default";
+    if (failures > 0) {
+        fprintf(stderr, "%d crypto tests failed on the %s path\n", failures, path);
+        return 1;
+    }
+    fprintf(stderr, "crypto tests passed on the %s path\n", path);
+    return 0;
+}
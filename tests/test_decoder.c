@@ -0,0 +1,94 @@
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "osnis.h"
+#include "wii.h"
+
+// Smaller than any block, like the sectors a disc drive reads
+#define READ_SIZE 0x800
+
+/**
+ * A shrunken image that can only be read forward, like a pipe
+ */
+struct ForwardInput
+{
+    FILE *f;
+    uint64_t position;
+};
+
+/**
+ * Read for the decoder, skipping forward is fine but going back fails
+ */
+static size_t readForward(void *context, unsigned char *buffer, size_t length, uint64_t offset)
+{
+    struct ForwardInput *input = context;
+    if (offset < input->position) {
+        fprintf(stderr, "TEST ERROR: the decoder went back from 0x%llx to 0x%llx\n",
+            (unsigned long long) input->position, (unsigned long long) offset);
+        return 0;
+    }
+    while (input->position < offset && getc(input->f) != EOF) {
+        input->position++;
+    }
+    if (input->position != offset) {
+        return 0;
+    }
+    size_t read = fread(buffer, 1, length, input->f);
+    input->position += read;
+    return read;
+}
+
+/**
+ * Pull the original image out of a shrunken image on stdin a sector at
+ * a time and check every sector against the original
+ */
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s keyFile original.iso < image.osnis\n", argv[0]);
+        return 1;
+    }
+
+    unsigned char key[16];
+    if (!readCommonKey(argv[1], key)) {
+        return 1;
+    }
+    FILE *original = fopen(argv[2], "rb");
+    if (original == NULL) {
+        fprintf(stderr, "TEST ERROR: could not open %s\n", argv[2]);
+        return 1;
+    }
+
+    struct ForwardInput input = {stdin, 0};
+    struct OsnisDecoder decoder;
+    if (!osnisDecoderInit(&decoder, readForward, &input, key)) {
+        fprintf(stderr, "TEST ERROR: %s\n", decoder.error);
+        osnisDecoderFree(&decoder);
+        return 1;
+    }
+
+    unsigned char buffer[READ_SIZE], expected[READ_SIZE];
+    uint64_t discSize = getDiscSize(decoder.discInfo);
+    uint64_t done = 0;
+    size_t read;
+    while ((read = osnisDecoderRead(&decoder, buffer, READ_SIZE)) > 0) {
+        if (fread(expected, 1, read, original) != read || memcmp(buffer, expected, read) != 0) {
+            fprintf(stderr, "TEST ERROR: the read at 0x%llx did not match\n", (unsigned long long) done);
+            break;
+        }
+        done += read;
+    }
+    bool passed = done == discSize;
+    if (!passed) {
+        fprintf(stderr, "TEST ERROR: read 0x%llx of 0x%llx bytes %s\n", (unsigned long long) done,
+            (unsigned long long) discSize, decoder.error);
+    }
+
+    osnisDecoderFree(&decoder);
+    fclose(original);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Shrink and unshrink a generated wii image with its partition decrypted,
+# on the default and software crypto paths, and check it comes back the same,
+# then read it back a sector at a time from a pipe through the decoder
+#
+# usage: wii_roundtrip.sh osnis make_wii test_decoder
+
+OSNIS=$1
+MAKE_WII=$2
+TEST_DECODER=$3
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+"$MAKE_WII" "$DIR/wii.iso" "$DIR/key.bin" || exit 1
+
+# the partition covers 47 whole blocks and one of them has hash padding
+# that is not zero, so it has to be stored encrypted instead
+EXPECTED="00046 BLOCKS DECRYPTED"
+
+for PATH_NAME in default software; do
+    # any value turns the simd paths off, even an empty one
+    if [ "$PATH_NAME" = software ]; then export OSNIS_NO_SIMD=1; fi
+
+    "$OSNIS" -s -k "$DIR/key.bin" -i "$DIR/wii.iso" -o "$DIR/wii.osnis" 2> "$DIR/shrink.log"
+    if ! grep -q "$EXPECTED" "$DIR/shrink.log"; then
+        echo "TEST ERROR: expected $EXPECTED on the $PATH_NAME path" >&2
+        grep "BLOCKS DECRYPTED" "$DIR/shrink.log" >&2
+        exit 1
+    fi
+
+    if ! "$OSNIS" -u -k "$DIR/key.bin" -i "$DIR/wii.osnis" 2> /dev/null | cmp -s - "$DIR/wii.iso"; then
+        echo "TEST ERROR: the unshrunken image is not the same on the $PATH_NAME path" >&2
+        exit 1
+    fi
+    echo "wii round trip passed on the $PATH_NAME path" >&2
+done
+
+if ! cat "$DIR/wii.osnis" | "$TEST_DECODER" "$DIR/key.bin" "$DIR/wii.iso"; then
+    echo "TEST ERROR: reading a sector at a time from a pipe did not match" >&2
+    exit 1
+fi
+echo "wii sector reads from a pipe passed" >&2